@@ -151,9 +151,16 @@ void initVariant(void);
 
 int atexit(void (*func)()) __attribute__((weak));
 
+// These also get an inline fast path after pins_arduino.h is included
+// below. The _ names call the functions in wiring_digital.c from there.
 void pinMode(uint8_t, uint8_t);
 void digitalWrite(uint8_t, uint8_t);
 int digitalRead(uint8_t);
+void digitalToggle(uint8_t);
+void _pinMode(uint8_t, uint8_t) __asm__("pinMode");
+void _digitalWrite(uint8_t, uint8_t) __asm__("digitalWrite");
+int _digitalRead(uint8_t) __asm__("digitalRead");
+void _digitalToggle(uint8_t) __asm__("digitalToggle");
 int analogRead(uint8_t);
 void analogReference(uint8_t mode);
 void analogWrite(uint8_t, int);
@@ -167,6 +174,8 @@ unsigned long pulseInLong(uint8_t pin, uint8_t state, unsigned long timeout);
 
 void shiftOut(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t val);
 uint8_t shiftIn(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder);
+void shiftOutBuffer(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, const uint8_t *buf, size_t len, unsigned long clock);
+void shiftInBuffer(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t *buf, size_t len, unsigned long clock);
 
 void attachInterrupt(uint8_t, void (*)(void), int mode);
 void detachInterrupt(uint8_t);
@@ -201,6 +210,13 @@ extern const uint8_t PROGMEM digital_pin_to_timer_PGM[];
 #define NOT_A_PIN 0
 #define NOT_A_PORT 0
 
+// Writing a one to a bit in PINx toggles the pin, on all but the oldest chips
+#if !defined(__AVR_ATmega8__) && !defined(__AVR_ATmega16__) && !defined(__AVR_ATmega32__) \
+&& !defined(__AVR_ATmega64__) && !defined(__AVR_ATmega128__) && !defined(__AVR_ATmega162__) \
+&& !defined(__AVR_ATmega8515__) && !defined(__AVR_ATmega8535__)
+#define HAVE_PINX_TOGGLE
+#endif
+
 #define EXTERNAL_INT_0 0
 #define EXTERNAL_INT_1 1
 #define EXTERNAL_INT_2 2
@@ -278,12 +294,100 @@ extern const uint8_t PROGMEM digital_pin_to_timer_PGM[];
 } // extern "C"
 #endif
 
+// The inline digital I/O wrappers below need the compile time pin tables
+#include "pins_arduino.h"
+
+// Constant pins that aren't PWM pins skip the table lookups, and compile
+// down to single sbi, cbi and sbis instructions. Everything else, and
+// variants without compile time pin tables, call the functions in
+// wiring_digital.c. These are gnu_inline definitions: they are only used
+// for inlining, and the functions keep their external symbols, so taking
+// their address or declaring them again works as before.
+#if defined(digitalPinToPortReg) && defined(digitalPinHasPWM)
+#define _digitalPinIsFast(P) (__builtin_constant_p(P) && (P) < NUM_DIGITAL_PINS \
+  && !digitalPinHasPWM(P) && (uintptr_t)digitalPinToPortReg(P) < 0x40)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define _DIGITAL_INLINE extern inline __attribute__((gnu_inline, always_inline))
+
+_DIGITAL_INLINE void pinMode(uint8_t pin, uint8_t mode)
+{
+#if defined(_digitalPinIsFast)
+  // Like wiring_digital.c, anything but INPUT and INPUT_PULLUP is an output
+  if (_digitalPinIsFast(pin) && __builtin_constant_p(mode))
+  {
+    if (mode == INPUT)
+    {
+      *digitalPinToDDRReg(pin) &= ~_BV(digitalPinToBit(pin));
+      *digitalPinToPortReg(pin) &= ~_BV(digitalPinToBit(pin));
+    }
+    else if (mode == INPUT_PULLUP)
+    {
+      *digitalPinToDDRReg(pin) &= ~_BV(digitalPinToBit(pin));
+      *digitalPinToPortReg(pin) |= _BV(digitalPinToBit(pin));
+    }
+    else
+      *digitalPinToDDRReg(pin) |= _BV(digitalPinToBit(pin));
+    return;
+  }
+#endif
+  _pinMode(pin, mode);
+}
+
+_DIGITAL_INLINE void digitalWrite(uint8_t pin, uint8_t val)
+{
+#if defined(_digitalPinIsFast)
+  if (_digitalPinIsFast(pin))
+  {
+    if (val == LOW)
+      *digitalPinToPortReg(pin) &= ~_BV(digitalPinToBit(pin));
+    else
+      *digitalPinToPortReg(pin) |= _BV(digitalPinToBit(pin));
+    return;
+  }
+#endif
+  _digitalWrite(pin, val);
+}
+
+_DIGITAL_INLINE int digitalRead(uint8_t pin)
+{
+#if defined(_digitalPinIsFast)
+  if (_digitalPinIsFast(pin))
+    return (*digitalPinToPINReg(pin) & _BV(digitalPinToBit(pin))) ? HIGH : LOW;
+#endif
+  return _digitalRead(pin);
+}
+
+_DIGITAL_INLINE void digitalToggle(uint8_t pin)
+{
+#if defined(_digitalPinIsFast) && defined(HAVE_PINX_TOGGLE)
+  if (_digitalPinIsFast(pin))
+  {
+    *digitalPinToPINReg(pin) |= _BV(digitalPinToBit(pin));
+    return;
+  }
+#endif
+  _digitalToggle(pin);
+}
+
+#undef _DIGITAL_INLINE
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
 #ifdef __cplusplus
 #include "WCharacter.h"
 #include "WString.h"
 #include "HardwareSerial.h"
 #include "USBAPI.h"
 #include "wiring_extras.h"
+#include "FastPin.h"
+#include "PinGroup.h"
 
 
 #if defined(HAVE_HWSERIAL0) && defined(HAVE_CDCSERIAL)
@@ -298,6 +402,12 @@ uint16_t makeWord(byte h, byte l);
 unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout = 1000000L);
 unsigned long pulseInLong(uint8_t pin, uint8_t state, unsigned long timeout = 1000000L);
 
+// Shift a whole buffer, see wiring_shift.c. A clock of 0 is as fast as possible.
+inline void shiftOut(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, const uint8_t *buf, size_t len, unsigned long clock = 0)
+  { shiftOutBuffer(dataPin, clockPin, bitOrder, buf, len, clock); }
+inline void shiftIn(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t *buf, size_t len, unsigned long clock = 0)
+  { shiftInBuffer(dataPin, clockPin, bitOrder, buf, len, clock); }
+
 void tone(uint8_t _pin, unsigned int frequency, unsigned long duration = 0);
 void noTone(uint8_t _pin);
 
@@ -309,6 +419,4 @@ long map(long, long, long, long, long);
 
 #endif
 
-#include "pins_arduino.h"
-
 #endif
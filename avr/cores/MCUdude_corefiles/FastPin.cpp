@@ -0,0 +1,57 @@
+/*
+  FastPin.cpp - Fast digital I/O for a single pin
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "Arduino.h"
+#include "FastPin.h"
+
+// Stands in for the registers of an invalid pin, so the inline methods
+// don't need to check for it
+static volatile uint8_t no_port;
+
+FastPin::FastPin(uint8_t pin)
+{
+  uint8_t port = digitalPinToPort(pin);
+  if (pin >= NUM_DIGITAL_PINS || port == NOT_A_PIN)
+  {
+    _in = _mode = _out = &no_port;
+    _mask = 0;
+    return;
+  }
+  _in = portInputRegister(port);
+  _mode = portModeRegister(port);
+  _out = portOutputRegister(port);
+  _mask = digitalPinToBitMask(pin);
+}
+
+void FastPin::mode(uint8_t mode)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  // Like pinMode(), anything but INPUT and INPUT_PULLUP is an output
+  if (mode == INPUT || mode == INPUT_PULLUP)
+  {
+    *_mode &= ~_mask;
+    if (mode == INPUT_PULLUP)
+      *_out |= _mask;
+    else
+      *_out &= ~_mask;
+  }
+  else
+    *_mode |= _mask;
+  SREG = oldSREG;
+}
@@ -0,0 +1,156 @@
+/*
+  FastPin.h - Fast digital I/O for a single pin
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef FastPin_h
+#define FastPin_h
+
+#include "Arduino.h"
+
+// digitalWrite() and friends look the pin up in three PROGMEM tables and
+// check for PWM on every call. FastPin does the lookup once, when it is
+// constructed, and FastPinT does it at compile time. Neither turns off
+// PWM on the pin, so call digitalWrite() once first if analogWrite() was
+// used on it.
+
+// A pin chosen at run time
+class FastPin
+{
+  private:
+    volatile uint8_t *_in;
+    volatile uint8_t *_mode;
+    volatile uint8_t *_out;
+    uint8_t _mask;
+
+  public:
+    FastPin(uint8_t pin);
+
+    void mode(uint8_t mode);
+
+    inline void write(uint8_t val)
+    {
+      uint8_t oldSREG = SREG;
+      cli();
+      if (val == LOW)
+        *_out &= ~_mask;
+      else
+        *_out |= _mask;
+      SREG = oldSREG;
+    }
+
+    inline void high() { write(HIGH); }
+    inline void low() { write(LOW); }
+
+    inline uint8_t read() { return (*_in & _mask) ? HIGH : LOW; }
+
+    inline void toggle()
+    {
+#if defined(HAVE_PINX_TOGGLE)
+      *_in = _mask;
+#else
+      uint8_t oldSREG = SREG;
+      cli();
+      *_out ^= _mask;
+      SREG = oldSREG;
+#endif
+    }
+};
+
+// A pin known at compile time. Everything compiles down to sbi, cbi, sbis
+// and in instructions, or a few more when the port is outside the range
+// of sbi and cbi (PORTH and up on the ATmega2560, PORTF on the ATmega128).
+template<uint8_t PIN>
+class FastPinT
+{
+  static_assert(PIN < NUM_DIGITAL_PINS, "Not a digital pin");
+
+  private:
+#if defined(digitalPinToPortReg)
+    static inline volatile uint8_t *in() { return digitalPinToPINReg(PIN); }
+    static inline volatile uint8_t *ddr() { return digitalPinToDDRReg(PIN); }
+    static inline volatile uint8_t *out() { return digitalPinToPortReg(PIN); }
+    static inline uint8_t mask() { return _BV(digitalPinToBit(PIN)); }
+    // sbi and cbi reach I/O addresses 0x00-0x1f only, which is data
+    // address 0x20-0x3f
+    static inline bool atomic(volatile uint8_t *reg) { return (uintptr_t)reg < 0x40; }
+#else
+    // The variant has no compile time tables, so look the pin up every time
+    static inline volatile uint8_t *in() { return portInputRegister(digitalPinToPort(PIN)); }
+    static inline volatile uint8_t *ddr() { return portModeRegister(digitalPinToPort(PIN)); }
+    static inline volatile uint8_t *out() { return portOutputRegister(digitalPinToPort(PIN)); }
+    static inline uint8_t mask() { return digitalPinToBitMask(PIN); }
+    static inline bool atomic(volatile uint8_t *) { return false; }
+#endif
+
+    static inline void setBit(volatile uint8_t *reg, uint8_t val) __attribute__((always_inline))
+    {
+      if (atomic(reg))
+      {
+        if (val == LOW)
+          *reg &= ~mask();
+        else
+          *reg |= mask();
+      }
+      else
+      {
+        uint8_t oldSREG = SREG;
+        cli();
+        if (val == LOW)
+          *reg &= ~mask();
+        else
+          *reg |= mask();
+        SREG = oldSREG;
+      }
+    }
+
+  public:
+    static inline void mode(uint8_t mode) __attribute__((always_inline))
+    {
+      // Like pinMode(), anything but INPUT and INPUT_PULLUP is an output
+      if (mode == INPUT || mode == INPUT_PULLUP)
+      {
+        setBit(ddr(), LOW);
+        setBit(out(), mode == INPUT_PULLUP);
+      }
+      else
+        setBit(ddr(), HIGH);
+    }
+
+    static inline void write(uint8_t val) __attribute__((always_inline)) { setBit(out(), val); }
+    static inline void high() __attribute__((always_inline)) { setBit(out(), HIGH); }
+    static inline void low() __attribute__((always_inline)) { setBit(out(), LOW); }
+
+    static inline uint8_t read() __attribute__((always_inline)) { return (*in() & mask()) ? HIGH : LOW; }
+
+    static inline void toggle() __attribute__((always_inline))
+    {
+#if defined(HAVE_PINX_TOGGLE)
+      // sbi only touches the one bit, a plain write is needed further up
+      if (atomic(in()))
+        *in() |= mask();
+      else
+        *in() = mask();
+#else
+      uint8_t oldSREG = SREG;
+      cli();
+      *out() ^= mask();
+      SREG = oldSREG;
+#endif
+    }
+};
+
+#endif
@@ -76,46 +76,28 @@ void serialEventRun(void)
 #endif
 }
 
-// Actual interrupt handlers //////////////////////////////////////////////////////////////
+// Public Methods //////////////////////////////////////////////////////////////
 
-void HardwareSerial::_tx_udr_empty_irq(void)
+uint16_t HardwareSerial::_baud_setting_for(unsigned long baud)
 {
-  // If interrupts are enabled, there must be more data in the output
-  // buffer. Send the next byte
-  unsigned char c = _tx_buffer[_tx_buffer_tail];
-  _tx_buffer_tail = (_tx_buffer_tail + 1) % SERIAL_TX_BUFFER_SIZE;
-
-  *_udr = c;
-
-  // clear the TXC bit -- "can be cleared by writing a one to its bit
-  // location". This makes sure flush() won't return until the bytes
-  // actually got written
-  sbi(*_ucsra, TXC0);
-
-  if (_tx_buffer_head == _tx_buffer_tail) {
-    // Buffer empty, so disable interrupts
-    cbi(*_ucsrb, UDRIE0);
-  }
+  return serialBaudSetting(baud);
 }
 
-// Public Methods //////////////////////////////////////////////////////////////
-
-void HardwareSerial::begin(unsigned long baud, byte config)
+void HardwareSerial::_begin(unsigned long baud, uint16_t baud_setting, uint8_t config)
 {
-  // Try u2x mode first
-  uint16_t baud_setting = (F_CPU / 4 / baud - 1) / 2;
-  *_ucsra = 1 << U2X0;
-
-  // hardcoded exception for 57600 for compatibility with the bootloader
-  // shipped with the Duemilanove and previous boards and the firmware
-  // on the 8U2 on the Uno and Mega 2560. Also, The baud_setting cannot
-  // be > 4095, so switch back to non-u2x mode if the baud rate is too
-  // low.
-  if (((F_CPU == 16000000UL) && (baud == 57600)) || (baud_setting >4095))
-  {
-    *_ucsra = 0;
-    baud_setting = (F_CPU / 8 / baud - 1) / 2;
-  }
+  _baud = baud;
+  _baud_setting = baud_setting;
+  *_ucsra = baud_setting & SERIAL_BAUD_U2X ? 1 << U2X0 : 0;
+  baud_setting &= ~SERIAL_BAUD_U2X;
+#if defined(SERIAL_ENABLE_9BIT)
+  _nine_bit = config & SERIAL_9BIT;
+  config &= ~SERIAL_9BIT;
+  // Address frames are told apart by the ninth bit
+  if (!_nine_bit)
+    _mpcm = false;
+  if (_mpcm)
+    sbi(*_ucsra, MPCM0);
+#endif
 
   // assign the baud_setting, a.k.a. ubrr (USART Baud Rate Register)
   *_ubrrh = baud_setting >> 8;
@@ -130,11 +112,160 @@ void HardwareSerial::begin(unsigned long baud, byte config)
   config |= 0x80; // select UCSRC register (shared with UBRRH)
 #endif
   *_ucsrc = config;
+#if defined(SERIAL_ENABLE_9BIT)
+  if (_nine_bit)
+    sbi(*_ucsrb, UCSZ02);
+  else
+    cbi(*_ucsrb, UCSZ02);
+#endif
   
   sbi(*_ucsrb, RXEN0);
   sbi(*_ucsrb, TXEN0);
   sbi(*_ucsrb, RXCIE0);
   cbi(*_ucsrb, UDRIE0);
+  // end() turned it off. The handler was registered by _update_txcie().
+  if (_de_port || _tx_complete_callback)
+    sbi(*_ucsrb, TXCIE0);
+}
+
+int16_t HardwareSerial::getBaudError(void)
+{
+  if (_baud == 0)
+    return 0;
+  long actual = getActualBaud();
+  return (actual - (long)_baud) * 1000L / (long)_baud;
+}
+
+// Baud rates that beginAuto() rounds a measurement to. 1000000 baud is 12
+// Timer1 ticks for 6 bits at 16 MHz, too coarse to round to anything.
+static const uint32_t autobaud_rates[] PROGMEM = {
+  600, 1200, 2400, 4800, 9600, 14400, 19200, 28800, 38400, 57600,
+  76800, 115200, 230400, 250000, 460800, 500000, 921600
+};
+
+// The edges are timed with interrupts disabled, but only for up to 2000
+// Timer1 ticks. With the prescaler of 64 wiring.c sets up, Timer0
+// overflows every 2048 ticks of Timer1 at any F_CPU, so millis() doesn't
+// miss a tick. Characters that take longer are slower
+// than about 8000 baud, where a few microseconds spent in an interrupt
+// handler don't matter any more.
+#define AUTOBAUD_IRQ_OFF_TICKS 2000
+
+// Waits for the RX pin to read level. Gives up when the Timer1 count,
+// which runs at F_CPU / 8 from 0 when interrupts were disabled, gets too
+// far from start.
+static bool autobaud_wait(volatile uint8_t *pin, uint8_t mask, uint8_t level, uint16_t start, uint8_t sreg)
+{
+  while ((*pin & mask) != level) {
+    uint16_t now = TCNT1;
+    if (now > AUTOBAUD_IRQ_OFF_TICKS)
+      SREG = sreg;
+    if ((uint16_t)(now - start) > 0xF000)
+      return false;
+  }
+  return true;
+}
+
+unsigned long HardwareSerial::beginAuto(unsigned long timeout, uint8_t config)
+{
+  if (!_rxpin)
+    return 0;
+
+  // Stop the receiver, or it fills the buffer with garbage at the old rate
+  end();
+
+  unsigned long start = millis();
+  for (;;) {
+    // Wait for an idle line, then for the falling edge of a start bit
+    while (!(*_rxpin & _rxmask))
+      if (millis() - start >= timeout)
+        return 0;
+    while (*_rxpin & _rxmask)
+      if (millis() - start >= timeout)
+        return 0;
+
+    // Interrupts could delay us past the start bit edge, so time from the
+    // second falling edge of 'U' (bit 1 is low) to the fifth (bit 7 is
+    // low), which is 6 bit times. The low time of bit 1 is checked against
+    // that to tell a 'U' from other characters. Timer1's own interrupts
+    // stay off while it is ours, since interrupts come back on during slow
+    // characters.
+    uint8_t oldSREG = SREG;
+    cli();
+    uint8_t tccr1a = TCCR1A;
+    uint8_t tccr1b = TCCR1B;
+    uint16_t tcnt1 = TCNT1;
+#if defined(TIMSK1)
+    uint8_t timsk1 = TIMSK1;
+    TIMSK1 = 0;
+#else
+    uint8_t timsk = TIMSK;
+    TIMSK &= ~(_BV(TICIE1) | _BV(OCIE1A) | _BV(OCIE1B) | _BV(TOIE1));
+#endif
+    TCCR1A = 0;
+    TCCR1B = _BV(CS11);
+    TCNT1 = 0;
+
+    bool ok = autobaud_wait(_rxpin, _rxmask, _rxmask, 0, oldSREG)   // end of the start bit
+           && autobaud_wait(_rxpin, _rxmask, 0, 0, oldSREG);        // bit 1
+    uint16_t bit1_start = TCNT1;
+    ok = ok && autobaud_wait(_rxpin, _rxmask, _rxmask, bit1_start, oldSREG);
+    uint16_t bit1_end = TCNT1;
+    ok = ok && autobaud_wait(_rxpin, _rxmask, 0, bit1_start, oldSREG)       // bit 3
+            && autobaud_wait(_rxpin, _rxmask, _rxmask, bit1_start, oldSREG)
+            && autobaud_wait(_rxpin, _rxmask, 0, bit1_start, oldSREG)       // bit 5
+            && autobaud_wait(_rxpin, _rxmask, _rxmask, bit1_start, oldSREG)
+            && autobaud_wait(_rxpin, _rxmask, 0, bit1_start, oldSREG);      // bit 7
+    uint16_t bit7_start = TCNT1;
+    // Let bit 7 pass, so the receiver is started on the stop bit and
+    // doesn't take the rest of the sync character for a start bit
+    ok = ok && autobaud_wait(_rxpin, _rxmask, _rxmask, bit1_start, oldSREG);
+
+    // Put Timer1 back the way we found it, and throw away any compare or
+    // overflow flags set while it was ours
+    cli();
+    TCCR1B = 0;
+    TCNT1 = tcnt1;
+    TCCR1A = tccr1a;
+#if defined(TIFR1)
+    TIFR1 = _BV(ICF1) | _BV(OCF1A) | _BV(OCF1B) | _BV(TOV1);
+#else
+    TIFR = _BV(ICF1) | _BV(OCF1A) | _BV(OCF1B) | _BV(TOV1);
+#endif
+    TCCR1B = tccr1b;
+#if defined(TIMSK1)
+    TIMSK1 = timsk1;
+#else
+    TIMSK = timsk;
+#endif
+    SREG = oldSREG;
+
+    if (!ok)
+      continue;
+    uint16_t span = bit7_start - bit1_start;
+    unsigned long low6 = 6UL * (uint16_t)(bit1_end - bit1_start);
+    unsigned long diff = low6 > span ? low6 - span : span - low6;
+    if (span == 0 || diff > span / 4)
+      continue;
+
+    // span is 6 bit times in units of 8 clock cycles
+    unsigned long baud = (3UL * F_CPU + span * 2UL) / (span * 4UL);
+    for (uint8_t i = 0; i < sizeof(autobaud_rates) / sizeof(autobaud_rates[0]); i++) {
+      unsigned long rate = pgm_read_dword(&autobaud_rates[i]);
+      unsigned long err = baud > rate ? baud - rate : rate - baud;
+      if (err <= rate / 25) {
+        baud = rate;
+        break;
+      }
+    }
+
+    // end() turned the receiver off, which flushes it, but make sure
+    // nothing of the sync character is left for the RX buffer
+    while (bit_is_set(*_ucsra, RXC0))
+      *_udr;
+    _begin(baud, _baud_setting_for(baud), config);
+    return baud;
+  }
 }
 
 void HardwareSerial::end()
@@ -146,107 +277,110 @@ void HardwareSerial::end()
   cbi(*_ucsrb, TXEN0);
   cbi(*_ucsrb, RXCIE0);
   cbi(*_ucsrb, UDRIE0);
+  cbi(*_ucsrb, TXCIE0);
   
   // clear any received data
-  _rx_buffer_head = _rx_buffer_tail;
+  _rx_buffer_clear();
+  _frame_queue_tail = _frame_queue_head;
 }
 
-int HardwareSerial::available(void)
+void HardwareSerial::setFrameDelimiter(uint8_t delimiter)
 {
-  return ((unsigned int)(SERIAL_RX_BUFFER_SIZE + _rx_buffer_head - _rx_buffer_tail)) % SERIAL_RX_BUFFER_SIZE;
+  uint8_t oldSREG = SREG;
+  cli();
+  _frame_mode = SERIAL_FRAME_DELIMITER;
+  _frame_delimiter = delimiter;
+  _frame_queue_tail = _frame_queue_head;
+  SREG = oldSREG;
 }
 
-int HardwareSerial::peek(void)
+void HardwareSerial::setFrameLength(uint8_t length)
 {
-  if (_rx_buffer_head == _rx_buffer_tail) {
-    return -1;
-  } else {
-    return _rx_buffer[_rx_buffer_tail];
-  }
+  uint8_t oldSREG = SREG;
+  cli();
+  _frame_mode = length ? SERIAL_FRAME_LENGTH : SERIAL_FRAME_NONE;
+  _frame_length = length;
+  _frame_fill = 0;
+  _frame_queue_tail = _frame_queue_head;
+  SREG = oldSREG;
 }
 
-int HardwareSerial::read(void)
+void HardwareSerial::disableFrames(void)
 {
-  // if the head isn't ahead of the tail, we don't have any characters
-  if (_rx_buffer_head == _rx_buffer_tail) {
-    return -1;
-  } else {
-    unsigned char c = _rx_buffer[_rx_buffer_tail];
-    _rx_buffer_tail = (rx_buffer_index_t)(_rx_buffer_tail + 1) % SERIAL_RX_BUFFER_SIZE;
-    return c;
-  }
+  uint8_t oldSREG = SREG;
+  cli();
+  _frame_mode = SERIAL_FRAME_NONE;
+  _frame_queue_tail = _frame_queue_head;
+  SREG = oldSREG;
 }
 
-int HardwareSerial::availableForWrite(void)
+#if defined(SERIAL_ENABLE_9BIT)
+bool HardwareSerial::setAddress(uint8_t address)
 {
-#if (SERIAL_TX_BUFFER_SIZE>256)
+  // RXB8 only tells address frames from data frames with 9 bit frames
+  if (!_nine_bit)
+    return false;
+
   uint8_t oldSREG = SREG;
   cli();
-#endif
-  tx_buffer_index_t head = _tx_buffer_head;
-  tx_buffer_index_t tail = _tx_buffer_tail;
-#if (SERIAL_TX_BUFFER_SIZE>256)
+  _mpcm_address = address;
+  _mpcm = true;
+  // Ignore everything up to the next address frame. Writing 0 to TXC
+  // leaves the flag alone.
+  *_ucsra = (*_ucsra & _BV(U2X0)) | _BV(MPCM0);
   SREG = oldSREG;
-#endif
-  if (head >= tail) return SERIAL_TX_BUFFER_SIZE - 1 - head + tail;
-  return tail - head - 1;
+  return true;
 }
 
-void HardwareSerial::flush()
+void HardwareSerial::clearAddress(void)
 {
-  // If we have never written a byte, no need to flush. This special
-  // case is needed since there is no way to force the TXC (transmit
-  // complete) bit to 1 during initialization
-  if (!_written)
-    return;
-
-  while (bit_is_set(*_ucsrb, UDRIE0) || bit_is_clear(*_ucsra, TXC0)) {
-    if (bit_is_clear(SREG, SREG_I) && bit_is_set(*_ucsrb, UDRIE0))
-      // Interrupts are globally disabled, but the DR empty
-      // interrupt should be enabled, so poll the DR empty flag to
-      // prevent deadlock
-      if (bit_is_set(*_ucsra, UDRE0))
-        _tx_udr_empty_irq();
-  }
-  // If we get here, nothing is queued anymore (DRIE is disabled) and
-  // the hardware finished tranmission (TXC is set).
+  uint8_t oldSREG = SREG;
+  cli();
+  _mpcm = false;
+  *_ucsra &= _BV(U2X0);
+  SREG = oldSREG;
 }
+#endif
 
-size_t HardwareSerial::write(uint8_t c)
+#if defined(SERIAL_ENABLE_STATS)
+void HardwareSerial::getStats(SerialStats &stats)
 {
-  _written = true;
-  // If the buffer and the data register is empty, just write the byte
-  // to the data register and be done. This shortcut helps
-  // significantly improve the effective datarate at high (>
-  // 500kbit/s) bitrates, where interrupt overhead becomes a slowdown.
-  if (_tx_buffer_head == _tx_buffer_tail && bit_is_set(*_ucsra, UDRE0)) {
-    *_udr = c;
-    sbi(*_ucsra, TXC0);
-    return 1;
-  }
-  tx_buffer_index_t i = (_tx_buffer_head + 1) % SERIAL_TX_BUFFER_SIZE;
-
-  // If the output buffer is full, there's nothing for it other than to 
-  // wait for the interrupt handler to empty it a bit
-  while (i == _tx_buffer_tail) {
-    if (bit_is_clear(SREG, SREG_I)) {
-      // Interrupts are disabled, so we'll have to poll the data
-      // register empty flag ourselves. If it is set, pretend an
-      // interrupt has happened and call the handler to free up
-      // space for us.
-      if(bit_is_set(*_ucsra, UDRE0))
-        _tx_udr_empty_irq();
-    } else {
-      // nop, the interrupt handler will free up space for us
-    }
-  }
-
-  _tx_buffer[_tx_buffer_head] = c;
-  _tx_buffer_head = i;
+  uint8_t oldSREG = SREG;
+  cli();
+  stats = _stats;
+  SREG = oldSREG;
+}
 
-  sbi(*_ucsrb, UDRIE0);
-  
-  return 1;
+void HardwareSerial::clearStats(void)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  memset(&_stats, 0, sizeof(_stats));
+  SREG = oldSREG;
 }
+#endif
+
+// The HardwareSerialT member functions are only defined in
+// HardwareSerial_private.h, so they are instantiated here for the buffer
+// sizes of every port. Ports with the same sizes share one instantiation.
+#define SERIAL_SAME_BUFFERS(a, b) \
+  (SERIAL##a##_RX_BUFFER_SIZE == SERIAL##b##_RX_BUFFER_SIZE && \
+   SERIAL##a##_TX_BUFFER_SIZE == SERIAL##b##_TX_BUFFER_SIZE)
+
+#if defined(HAVE_HWSERIAL0)
+template class HardwareSerialT<SERIAL0_RX_BUFFER_SIZE, SERIAL0_TX_BUFFER_SIZE>;
+#endif
+#if defined(HAVE_HWSERIAL1) && !(defined(HAVE_HWSERIAL0) && SERIAL_SAME_BUFFERS(1, 0))
+template class HardwareSerialT<SERIAL1_RX_BUFFER_SIZE, SERIAL1_TX_BUFFER_SIZE>;
+#endif
+#if defined(HAVE_HWSERIAL2) && !(defined(HAVE_HWSERIAL0) && SERIAL_SAME_BUFFERS(2, 0)) \
+  && !(defined(HAVE_HWSERIAL1) && SERIAL_SAME_BUFFERS(2, 1))
+template class HardwareSerialT<SERIAL2_RX_BUFFER_SIZE, SERIAL2_TX_BUFFER_SIZE>;
+#endif
+#if defined(HAVE_HWSERIAL3) && !(defined(HAVE_HWSERIAL0) && SERIAL_SAME_BUFFERS(3, 0)) \
+  && !(defined(HAVE_HWSERIAL1) && SERIAL_SAME_BUFFERS(3, 1)) \
+  && !(defined(HAVE_HWSERIAL2) && SERIAL_SAME_BUFFERS(3, 2))
+template class HardwareSerialT<SERIAL3_RX_BUFFER_SIZE, SERIAL3_TX_BUFFER_SIZE>;
+#endif
 
 #endif // whole file
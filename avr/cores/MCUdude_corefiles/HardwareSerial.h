@@ -53,17 +53,56 @@
 #define SERIAL_RX_BUFFER_SIZE 64
 #endif
 #endif
-#if (SERIAL_TX_BUFFER_SIZE>256)
-typedef uint16_t tx_buffer_index_t;
-#else
-typedef uint8_t tx_buffer_index_t;
+// Every port can get its own buffer sizes by defining SERIALn_TX_BUFFER_SIZE
+// and SERIALn_RX_BUFFER_SIZE. Ports that don't, use the sizes above.
+#if !defined(SERIAL0_TX_BUFFER_SIZE)
+#define SERIAL0_TX_BUFFER_SIZE SERIAL_TX_BUFFER_SIZE
 #endif
-#if  (SERIAL_RX_BUFFER_SIZE>256)
-typedef uint16_t rx_buffer_index_t;
-#else
-typedef uint8_t rx_buffer_index_t;
+#if !defined(SERIAL0_RX_BUFFER_SIZE)
+#define SERIAL0_RX_BUFFER_SIZE SERIAL_RX_BUFFER_SIZE
+#endif
+#if !defined(SERIAL1_TX_BUFFER_SIZE)
+#define SERIAL1_TX_BUFFER_SIZE SERIAL_TX_BUFFER_SIZE
+#endif
+#if !defined(SERIAL1_RX_BUFFER_SIZE)
+#define SERIAL1_RX_BUFFER_SIZE SERIAL_RX_BUFFER_SIZE
+#endif
+#if !defined(SERIAL2_TX_BUFFER_SIZE)
+#define SERIAL2_TX_BUFFER_SIZE SERIAL_TX_BUFFER_SIZE
+#endif
+#if !defined(SERIAL2_RX_BUFFER_SIZE)
+#define SERIAL2_RX_BUFFER_SIZE SERIAL_RX_BUFFER_SIZE
+#endif
+#if !defined(SERIAL3_TX_BUFFER_SIZE)
+#define SERIAL3_TX_BUFFER_SIZE SERIAL_TX_BUFFER_SIZE
+#endif
+#if !defined(SERIAL3_RX_BUFFER_SIZE)
+#define SERIAL3_RX_BUFFER_SIZE SERIAL_RX_BUFFER_SIZE
+#endif
+
+// Number of complete RX frames whose boundaries are remembered in frame
+// mode (see setFrameDelimiter() and setFrameLength())
+#if !defined(SERIAL_RX_FRAME_QUEUE_SIZE)
+#define SERIAL_RX_FRAME_QUEUE_SIZE 4
 #endif
 
+// Define SERIAL_ENABLE_STATS (e.g. in build.extra_flags) to make every port
+// count receive errors and track how full its buffers got. See getStats().
+#if defined(SERIAL_ENABLE_STATS)
+struct SerialStats {
+  uint16_t frame_errors;     // Bytes received with a bad stop bit (FE)
+  uint16_t data_overruns;    // Bytes lost before UDR was read (DOR)
+  uint16_t parity_errors;    // Bytes discarded because of a parity error
+  uint16_t rx_buffer_drops;  // Bytes discarded because the RX buffer was full
+  uint16_t rx_high_water;    // Most bytes ever waiting in the RX buffer
+  uint16_t tx_high_water;    // Most bytes ever waiting in the TX buffer
+};
+#endif
+
+// Picks the smallest index type that can address a buffer of the given size
+template<bool wide> struct serial_buffer_index { typedef uint8_t type; };
+template<> struct serial_buffer_index<true> { typedef uint16_t type; };
+
 // Define config for Serial.begin(baud, config);
 #define SERIAL_5N1 0x00
 #define SERIAL_6N1 0x02
@@ -90,6 +129,64 @@ typedef uint8_t rx_buffer_index_t;
 #define SERIAL_7O2 0x3C
 #define SERIAL_8O2 0x3E
 
+// 9 bit frames are only available when SERIAL_ENABLE_9BIT is defined, since
+// the ninth bit of every buffered byte has to be stored separately
+#if defined(SERIAL_ENABLE_9BIT)
+#define SERIAL_9BIT 0x01
+#define SERIAL_9N1 (SERIAL_8N1 | SERIAL_9BIT)
+#define SERIAL_9N2 (SERIAL_8N2 | SERIAL_9BIT)
+#define SERIAL_9E1 (SERIAL_8E1 | SERIAL_9BIT)
+#define SERIAL_9E2 (SERIAL_8E2 | SERIAL_9BIT)
+#define SERIAL_9O1 (SERIAL_8O1 | SERIAL_9BIT)
+#define SERIAL_9O2 (SERIAL_8O2 | SERIAL_9BIT)
+#endif
+
+// Frame modes, see setFrameDelimiter() and setFrameLength()
+#define SERIAL_FRAME_NONE      0
+#define SERIAL_FRAME_DELIMITER 1
+#define SERIAL_FRAME_LENGTH    2
+
+// Baud rate solver. Returns the UBRR value for the given baud rate, with
+// SERIAL_BAUD_U2X set if double speed mode should be used. Both modes are
+// tried with UBRR rounded to the nearest value, and the one that gets
+// closest to the requested baud rate wins. Normal speed mode is preferred
+// on a tie, since it samples every bit more often. When baud is a compile
+// time constant, the whole calculation is folded into a constant.
+#define SERIAL_BAUD_U2X 0x8000
+
+static inline uint16_t serialBaudSetting(unsigned long baud) __attribute__((always_inline, unused));
+static inline uint16_t serialBaudSetting(unsigned long baud)
+{
+  unsigned long div_u2x = (F_CPU + 4UL * baud) / (8UL * baud);
+  unsigned long div_1x = (F_CPU + 8UL * baud) / (16UL * baud);
+  if (div_u2x == 0) div_u2x = 1;
+  if (div_1x == 0) div_1x = 1;
+  if (div_1x > 4096) div_1x = 4096;
+
+  // UBRR can't be larger than 4095, so low baud rates need normal mode
+  if (div_u2x > 4096)
+    return div_1x - 1;
+
+  unsigned long baud_u2x = F_CPU / (8UL * div_u2x);
+  unsigned long baud_1x = F_CPU / (16UL * div_1x);
+  unsigned long err_u2x = baud_u2x > baud ? baud_u2x - baud : baud - baud_u2x;
+  unsigned long err_1x = baud_1x > baud ? baud_1x - baud : baud - baud_1x;
+  if (err_1x <= err_u2x)
+    return div_1x - 1;
+  return (div_u2x - 1) | SERIAL_BAUD_U2X;
+}
+
+// Baud rate that a setting returned by serialBaudSetting() really gives
+static inline unsigned long serialActualBaud(uint16_t setting) __attribute__((always_inline, unused));
+static inline unsigned long serialActualBaud(uint16_t setting)
+{
+  unsigned long div = (setting & ~SERIAL_BAUD_U2X) + 1UL;
+  return F_CPU / ((setting & SERIAL_BAUD_U2X ? 8UL : 16UL) * div);
+}
+
+// HardwareSerial holds the UART registers and everything that doesn't
+// depend on the buffer sizes. Pass HardwareSerial& or HardwareSerial* around
+// to write code that works with any port.
 class HardwareSerial : public Stream
 {
   protected:
@@ -99,60 +196,250 @@ class HardwareSerial : public Stream
     volatile uint8_t * const _ucsrb;
     volatile uint8_t * const _ucsrc;
     volatile uint8_t * const _udr;
+    // Input register and mask of the RX pin, for beginAuto()
+    volatile uint8_t * const _rxpin;
+    const uint8_t _rxmask;
+    // Requested baud rate and the setting picked for it in begin()
+    unsigned long _baud;
+    uint16_t _baud_setting;
+    // RS-485 driver enable pin, see setDriverEnablePin()
+    volatile uint8_t *_de_port;
+    uint8_t _de_mask;
+    uint8_t _de_on;
+    // Called from the transmit complete interrupt, see onTxComplete()
+    void (*_tx_complete_callback)(void);
+    // Set by the transmit complete interrupt, which clears TXC on its way
+    volatile bool _tx_idle;
     // Has any byte been written to the UART since begin()
     bool _written;
+    // Should write() wait for room in the TX buffer (default) or return
+    // the number of bytes that could be queued right away
+    bool _write_blocking;
+
+    // Frame mode state, shared with the RX interrupt handler
+    uint8_t _frame_mode;
+    uint8_t _frame_delimiter;
+    uint8_t _frame_length;
+    uint8_t _frame_fill;
+    volatile uint8_t _frame_queue_head;
+    volatile uint8_t _frame_queue_tail;
+#if defined(SERIAL_ENABLE_STATS)
+    SerialStats _stats;
+#endif
+#if defined(SERIAL_ENABLE_9BIT)
+    bool _nine_bit;
+    bool _mpcm;
+    uint8_t _mpcm_address;
+#endif
 
-    volatile rx_buffer_index_t _rx_buffer_head;
-    volatile rx_buffer_index_t _rx_buffer_tail;
-    volatile tx_buffer_index_t _tx_buffer_head;
-    volatile tx_buffer_index_t _tx_buffer_tail;
+    inline HardwareSerial(
+      volatile uint8_t *ubrrh, volatile uint8_t *ubrrl,
+      volatile uint8_t *ucsra, volatile uint8_t *ucsrb,
+      volatile uint8_t *ucsrc, volatile uint8_t *udr,
+      volatile uint8_t *rxpin = 0, uint8_t rxmask = 0);
+
+    // Throw away everything in the RX buffer, used by end()
+    virtual void _rx_buffer_clear(void) = 0;
+
+    inline void _de_assert(void);
+    inline void _de_release(void);
+    inline void _tx_direct(uint8_t c);
+    void _update_txcie(void);
+
+    void _begin(unsigned long baud, uint16_t baud_setting, uint8_t config);
+    static uint16_t _baud_setting_for(unsigned long baud);
+
+  public:
+    void begin(unsigned long baud) { begin(baud, SERIAL_8N1); }
+    inline void begin(unsigned long baud, uint8_t config) __attribute__((always_inline))
+    {
+      // Constant baud rates get their setting calculated at compile time,
+      // others call the solver at run time instead of inlining it here
+      if (__builtin_constant_p(baud))
+        _begin(baud, serialBaudSetting(baud), config);
+      else
+        _begin(baud, _baud_setting_for(baud), config);
+    }
+    // Waits for the other side to send a 'U' (0x55) sync character, takes
+    // the baud rate from its edges and starts the UART at that rate. Rates
+    // within 4% of a standard baud rate are rounded to it. Returns the baud
+    // rate, or 0 if nothing valid was seen within timeout milliseconds.
+    // The sync character itself is consumed. Timer1 is borrowed for a
+    // character time while measuring, so its PWM outputs and interrupts
+    // (Servo, tone()) glitch once. Works from 600 baud up to about F_CPU / 64
+    // (250000 baud at 16 MHz). Above that the edges are only timed to 8
+    // clock cycles, so neighbouring standard rates can't be told apart and
+    // the rate is used as measured.
+    unsigned long beginAuto(unsigned long timeout = 5000, uint8_t config = SERIAL_8N1);
+    void end();
+    virtual int available(void) = 0;
+    virtual int peek(void) = 0;
+    virtual int read(void) = 0;
+    virtual int readAvailable(uint8_t *buffer, size_t size) = 0;
+    // Copies up to size bytes that are already buffered, without waiting
+    inline int read(uint8_t *buffer, size_t size) { return readAvailable(buffer, size); }
+    virtual int availableForWrite(void) = 0;
+    virtual void flush(void) = 0;
+    // As flush(), but gives up after timeout milliseconds. Returns true if
+    // everything was sent. millis() doesn't advance with interrupts off, so
+    // only use this with interrupts enabled.
+    virtual bool flush(unsigned long timeout) = 0;
+    virtual size_t write(uint8_t) = 0;
+    inline size_t write(unsigned long n) { return write((uint8_t)n); }
+    inline size_t write(long n) { return write((uint8_t)n); }
+    inline size_t write(unsigned int n) { return write((uint8_t)n); }
+    inline size_t write(int n) { return write((uint8_t)n); }
+    virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+    using Print::write; // pull in write(str) and write(buf, size) from Print
+    // In non-blocking mode write() never waits for the TX buffer to drain.
+    // Bytes that don't fit are dropped, the return value tells how many
+    // were actually queued and getWriteError() is set.
+    void setWriteBlocking(bool blocking) { _write_blocking = blocking; }
+    bool getWriteBlocking(void) { return _write_blocking; }
+
+    // The baud rate the UART really runs at after begin(), and how far that
+    // is off from the requested baud rate, in tenths of a percent
+    unsigned long getActualBaud(void) { return serialActualBaud(_baud_setting); }
+    int16_t getBaudError(void);
+
+    // In frame mode the RX interrupt handler records where each frame ends,
+    // either at the delimiter byte or after a fixed number of bytes. A
+    // complete frame can then be fetched with a single readFrame() call, and
+    // serialEvent() only runs once a complete frame has arrived. Frames
+    // that were read byte by byte with read() or readAvailable() are done
+    // as soon as their last byte is read.
+    void setFrameDelimiter(uint8_t delimiter);
+    void setFrameLength(uint8_t length);
+    void disableFrames(void);
+    uint8_t getFrameMode(void) { return _frame_mode; }
+    bool frameAvailable(void) { return _frame_queue_head != _frame_queue_tail; }
+    // Copies the oldest complete frame, including its delimiter, and
+    // returns its length, or -1 if no frame is complete yet. Bytes that
+    // don't fit in the buffer are discarded.
+    virtual int readFrame(uint8_t *buffer, size_t size) = 0;
+
+    // RS-485 half duplex: the driver enable pin is asserted right before
+    // the first byte goes out, and released from the transmit complete
+    // interrupt once the last stop bit has left the shift register. This
+    // and onTxComplete() link in the ISR(USARTn_TX_vect) of every port, so
+    // a sketch that uses them can't define those vectors itself.
+    void setDriverEnablePin(uint8_t pin, bool active_high = true);
+    void clearDriverEnablePin(void);
+
+    // The callback runs from the transmit complete interrupt as soon as the
+    // TX buffer, the data register and the shift register are all empty,
+    // so keep it short. Pass NULL to remove it.
+    void onTxComplete(void (*callback)(void));
+    // Transmit complete interrupt handler - Not intended to be called
+    // externally
+    void _tx_complete_irq(void);
+#if defined(SERIAL_ENABLE_STATS)
+    // Takes a consistent snapshot of the error counters and high water marks
+    void getStats(SerialStats &stats);
+    void clearStats(void);
+#endif
+#if defined(SERIAL_ENABLE_9BIT)
+    // With a SERIAL_9xx config, read9() and write9() transfer the ninth bit
+    // as bit 8 of the value. read() and write() work on the low 8 bits and
+    // send the ninth bit as zero.
+    virtual int read9(void) = 0;
+    virtual size_t write9(uint16_t) = 0;
+    // Multi-processor communication mode: the UART ignores all data frames
+    // (ninth bit cleared) until an address frame (ninth bit set) with this
+    // address arrives. Address frames never end up in the RX buffer. Only
+    // works with a SERIAL_9xx config, so call it after begin(). Returns
+    // false with any other config, and begin() without the ninth bit turns
+    // it off again.
+    bool setAddress(uint8_t address);
+    void clearAddress(void);
+    size_t writeAddress(uint8_t address) { return write9(0x100 | address); }
+#endif
+    operator bool() { return true; }
+};
+
+// The ring buffers of every port are sized at compile time through the
+// template arguments (see SERIALn_RX_BUFFER_SIZE above). With power of two
+// sizes all modulo operations on the buffer indices become simple masks.
+template<unsigned int RX_BUFFER_SIZE, unsigned int TX_BUFFER_SIZE>
+class HardwareSerialT : public HardwareSerial
+{
+  protected:
+    typedef typename serial_buffer_index<(RX_BUFFER_SIZE > 256)>::type rx_index_t;
+    typedef typename serial_buffer_index<(TX_BUFFER_SIZE > 256)>::type tx_index_t;
+
+    volatile rx_index_t _rx_buffer_head;
+    volatile rx_index_t _rx_buffer_tail;
+    volatile tx_index_t _tx_buffer_head;
+    volatile tx_index_t _tx_buffer_tail;
+
+    // Buffer index right after the end of every complete frame
+    rx_index_t _frame_end[SERIAL_RX_FRAME_QUEUE_SIZE];
+
+#if defined(SERIAL_ENABLE_9BIT)
+    // Ninth bit of every byte in the ring buffers, one bit per byte
+    uint8_t _rx_bit8[(RX_BUFFER_SIZE + 7) / 8];
+    uint8_t _tx_bit8[(TX_BUFFER_SIZE + 7) / 8];
+#endif
 
     // Don't put any members after these buffers, since only the first
     // 32 bytes of this struct can be accessed quickly using the ldd
     // instruction.
-    unsigned char _rx_buffer[SERIAL_RX_BUFFER_SIZE];
-    unsigned char _tx_buffer[SERIAL_TX_BUFFER_SIZE];
+    unsigned char _rx_buffer[RX_BUFFER_SIZE];
+    unsigned char _tx_buffer[TX_BUFFER_SIZE];
+
+    virtual void _rx_buffer_clear(void);
+    inline void _rx_advance(rx_index_t tail, size_t count);
+    inline void _rx_copy(uint8_t *buffer, rx_index_t tail, size_t count);
+#if defined(SERIAL_ENABLE_STATS)
+    inline void _tx_high_water(tx_index_t head);
+#endif
 
   public:
-    inline HardwareSerial(
+    inline HardwareSerialT(
       volatile uint8_t *ubrrh, volatile uint8_t *ubrrl,
       volatile uint8_t *ucsra, volatile uint8_t *ucsrb,
-      volatile uint8_t *ucsrc, volatile uint8_t *udr);
-    void begin(unsigned long baud) { begin(baud, SERIAL_8N1); }
-    void begin(unsigned long, uint8_t);
-    void end();
+      volatile uint8_t *ucsrc, volatile uint8_t *udr,
+      volatile uint8_t *rxpin = 0, uint8_t rxmask = 0);
     virtual int available(void);
     virtual int peek(void);
     virtual int read(void);
+    virtual int readAvailable(uint8_t *buffer, size_t size);
+    using HardwareSerial::read; // pull in read(buffer, size)
     virtual int availableForWrite(void);
     virtual void flush(void);
+    virtual bool flush(unsigned long timeout);
+    using HardwareSerial::flush;
     virtual size_t write(uint8_t);
-    inline size_t write(unsigned long n) { return write((uint8_t)n); }
-    inline size_t write(long n) { return write((uint8_t)n); }
-    inline size_t write(unsigned int n) { return write((uint8_t)n); }
-    inline size_t write(int n) { return write((uint8_t)n); }
-    using Print::write; // pull in write(str) and write(buf, size) from Print
-    operator bool() { return true; }
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    using HardwareSerial::write; // pull in the remaining write() overloads
+    virtual int readFrame(uint8_t *buffer, size_t size);
+#if defined(SERIAL_ENABLE_9BIT)
+    virtual int read9(void);
+    virtual size_t write9(uint16_t);
+#endif
 
     // Interrupt handlers - Not intended to be called externally
     inline void _rx_complete_irq(void);
     void _tx_udr_empty_irq(void);
+
+  protected:
+    inline bool _tx_busy(void);
 };
 
 #if defined(UBRRH) || defined(UBRR0H)
-  extern HardwareSerial Serial;
+  extern HardwareSerialT<SERIAL0_RX_BUFFER_SIZE, SERIAL0_TX_BUFFER_SIZE> Serial;
   #define HAVE_HWSERIAL0
 #endif
 #if defined(UBRR1H)
-  extern HardwareSerial Serial1;
+  extern HardwareSerialT<SERIAL1_RX_BUFFER_SIZE, SERIAL1_TX_BUFFER_SIZE> Serial1;
   #define HAVE_HWSERIAL1
 #endif
 #if defined(UBRR2H)
-  extern HardwareSerial Serial2;
+  extern HardwareSerialT<SERIAL2_RX_BUFFER_SIZE, SERIAL2_TX_BUFFER_SIZE> Serial2;
   #define HAVE_HWSERIAL2
 #endif
 #if defined(UBRR3H)
-  extern HardwareSerial Serial3;
+  extern HardwareSerialT<SERIAL3_RX_BUFFER_SIZE, SERIAL3_TX_BUFFER_SIZE> Serial3;
   #define HAVE_HWSERIAL3
 #endif
 
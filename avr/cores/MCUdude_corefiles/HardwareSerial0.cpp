@@ -36,6 +36,10 @@
 
 #if defined(HAVE_HWSERIAL0)
 
+// The member functions are instantiated in HardwareSerial.cpp, once for
+// every distinct pair of buffer sizes
+extern template class HardwareSerialT<SERIAL0_RX_BUFFER_SIZE, SERIAL0_TX_BUFFER_SIZE>;
+
 #if defined(USART_RX_vect)
   ISR(USART_RX_vect)
 #elif defined(USART0_RX_vect)
@@ -65,14 +69,17 @@ ISR(USART0_UDRE_vect)
 }
 
 #if defined(UBRRH) && defined(UBRRL)
-  HardwareSerial Serial(&UBRRH, &UBRRL, &UCSRA, &UCSRB, &UCSRC, &UDR);
+  HardwareSerialT<SERIAL0_RX_BUFFER_SIZE, SERIAL0_TX_BUFFER_SIZE> Serial(&UBRRH, &UBRRL, &UCSRA, &UCSRB, &UCSRC, &UDR, SERIAL0_RX_PIN);
 #else
-  HardwareSerial Serial(&UBRR0H, &UBRR0L, &UCSR0A, &UCSR0B, &UCSR0C, &UDR0);
+  HardwareSerialT<SERIAL0_RX_BUFFER_SIZE, SERIAL0_TX_BUFFER_SIZE> Serial(&UBRR0H, &UBRR0L, &UCSR0A, &UCSR0B, &UCSR0C, &UDR0, SERIAL0_RX_PIN);
 #endif
 
 // Function that can be weakly referenced by serialEventRun to prevent
 // pulling in this file if it's not otherwise used.
 bool Serial0_available() {
+  // In frame mode serialEvent() only runs once a complete frame arrived
+  if (Serial.getFrameMode() != SERIAL_FRAME_NONE)
+    return Serial.frameAvailable();
   return Serial.available();
 }
 
@@ -36,6 +36,10 @@
 
 #if defined(HAVE_HWSERIAL1)
 
+// The member functions are instantiated in HardwareSerial.cpp, once for
+// every distinct pair of buffer sizes
+extern template class HardwareSerialT<SERIAL1_RX_BUFFER_SIZE, SERIAL1_TX_BUFFER_SIZE>;
+
 #if defined(UART1_RX_vect)
 ISR(UART1_RX_vect)
 #elif defined(USART1_RX_vect)
@@ -60,11 +64,14 @@ ISR(USART1_UDRE_vect)
   Serial1._tx_udr_empty_irq();
 }
 
-HardwareSerial Serial1(&UBRR1H, &UBRR1L, &UCSR1A, &UCSR1B, &UCSR1C, &UDR1);
+HardwareSerialT<SERIAL1_RX_BUFFER_SIZE, SERIAL1_TX_BUFFER_SIZE> Serial1(&UBRR1H, &UBRR1L, &UCSR1A, &UCSR1B, &UCSR1C, &UDR1, SERIAL1_RX_PIN);
 
 // Function that can be weakly referenced by serialEventRun to prevent
 // pulling in this file if it's not otherwise used.
 bool Serial1_available() {
+  // In frame mode serialEvent1() only runs once a complete frame arrived
+  if (Serial1.getFrameMode() != SERIAL_FRAME_NONE)
+    return Serial1.frameAvailable();
   return Serial1.available();
 }
 
@@ -36,6 +36,10 @@
 
 #if defined(HAVE_HWSERIAL2)
 
+// The member functions are instantiated in HardwareSerial.cpp, once for
+// every distinct pair of buffer sizes
+extern template class HardwareSerialT<SERIAL2_RX_BUFFER_SIZE, SERIAL2_TX_BUFFER_SIZE>;
+
 ISR(USART2_RX_vect)
 {
   Serial2._rx_complete_irq();
@@ -46,11 +50,14 @@ ISR(USART2_UDRE_vect)
   Serial2._tx_udr_empty_irq();
 }
 
-HardwareSerial Serial2(&UBRR2H, &UBRR2L, &UCSR2A, &UCSR2B, &UCSR2C, &UDR2);
+HardwareSerialT<SERIAL2_RX_BUFFER_SIZE, SERIAL2_TX_BUFFER_SIZE> Serial2(&UBRR2H, &UBRR2L, &UCSR2A, &UCSR2B, &UCSR2C, &UDR2, SERIAL2_RX_PIN);
 
 // Function that can be weakly referenced by serialEventRun to prevent
 // pulling in this file if it's not otherwise used.
 bool Serial2_available() {
+  // In frame mode serialEvent2() only runs once a complete frame arrived
+  if (Serial2.getFrameMode() != SERIAL_FRAME_NONE)
+    return Serial2.frameAvailable();
   return Serial2.available();
 }
 
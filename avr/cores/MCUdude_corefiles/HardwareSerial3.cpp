@@ -36,6 +36,10 @@
 
 #if defined(HAVE_HWSERIAL3)
 
+// The member functions are instantiated in HardwareSerial.cpp, once for
+// every distinct pair of buffer sizes
+extern template class HardwareSerialT<SERIAL3_RX_BUFFER_SIZE, SERIAL3_TX_BUFFER_SIZE>;
+
 ISR(USART3_RX_vect)
 {
   Serial3._rx_complete_irq();
@@ -46,11 +50,14 @@ ISR(USART3_UDRE_vect)
   Serial3._tx_udr_empty_irq();
 }
 
-HardwareSerial Serial3(&UBRR3H, &UBRR3L, &UCSR3A, &UCSR3B, &UCSR3C, &UDR3);
+HardwareSerialT<SERIAL3_RX_BUFFER_SIZE, SERIAL3_TX_BUFFER_SIZE> Serial3(&UBRR3H, &UBRR3L, &UCSR3A, &UCSR3B, &UCSR3C, &UDR3, SERIAL3_RX_PIN);
 
 // Function that can be weakly referenced by serialEventRun to prevent
 // pulling in this file if it's not otherwise used.
 bool Serial3_available() {
+  // In frame mode serialEvent3() only runs once a complete frame arrived
+  if (Serial3.getFrameMode() != SERIAL_FRAME_NONE)
+    return Serial3.frameAvailable();
   return Serial3.available();
 }
 
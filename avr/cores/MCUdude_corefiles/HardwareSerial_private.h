@@ -41,23 +41,39 @@
 #endif
 // On ATmega8, the uart and its bits are not numbered, so there is no TXC0 etc.
 #define TXC0 TXC
+#define RXC0 RXC
 #define RXEN0 RXEN
 #define TXEN0 TXEN
 #define RXCIE0 RXCIE
+#define TXCIE0 TXCIE
 #define UDRIE0 UDRIE
 #define U2X0 U2X
 #define UPE0 UPE
 #define UDRE0 UDRE
+#define UCSZ02 UCSZ2
+#define RXB80 RXB8
+#define TXB80 TXB8
+#define MPCM0 MPCM
+#define FE0 FE
+#define DOR0 DOR
 #elif defined(TXC1)
 // Some devices have uart1 but no uart0
 #define TXC0 TXC1
+#define RXC0 RXC1
 #define RXEN0 RXEN1
 #define TXEN0 TXEN1
 #define RXCIE0 RXCIE1
+#define TXCIE0 TXCIE1
 #define UDRIE0 UDRIE1
 #define U2X0 U2X1
 #define UPE0 UPE1
 #define UDRE0 UDRE1
+#define UCSZ02 UCSZ12
+#define RXB80 RXB81
+#define TXB80 TXB81
+#define MPCM0 MPCM1
+#define FE0 FE1
+#define DOR0 DOR1
 #else
 #error No UART found in HardwareSerial.cpp
 #endif
@@ -66,45 +82,173 @@
 // Check at compiletime that it is really ok to use the bit positions of
 // UART0 for the other UARTs as well, in case these values ever get
 // changed for future hardware.
-#if defined(TXC1) && (TXC1 != TXC0 || RXEN1 != RXEN0 || RXCIE1 != RXCIE0 || \
+#if defined(TXC1) && (TXC1 != TXC0 || RXC1 != RXC0 || RXEN1 != RXEN0 || RXCIE1 != RXCIE0 || TXCIE1 != TXCIE0 || \
           UDRIE1 != UDRIE0 || U2X1 != U2X0 || UPE1 != UPE0 || \
-          UDRE1 != UDRE0)
+          UDRE1 != UDRE0 || FE1 != FE0 || DOR1 != DOR0 || \
+          UCSZ12 != UCSZ02 || RXB81 != RXB80 || TXB81 != TXB80 || \
+          MPCM1 != MPCM0)
 #error "Not all bit positions for UART1 are the same as for UART0"
 #endif
-#if defined(TXC2) && (TXC2 != TXC0 || RXEN2 != RXEN0 || RXCIE2 != RXCIE0 || \
+#if defined(TXC2) && (TXC2 != TXC0 || RXC2 != RXC0 || RXEN2 != RXEN0 || RXCIE2 != RXCIE0 || TXCIE2 != TXCIE0 || \
           UDRIE2 != UDRIE0 || U2X2 != U2X0 || UPE2 != UPE0 || \
-          UDRE2 != UDRE0)
+          UDRE2 != UDRE0 || FE2 != FE0 || DOR2 != DOR0 || \
+          UCSZ22 != UCSZ02 || RXB82 != RXB80 || TXB82 != TXB80 || \
+          MPCM2 != MPCM0)
 #error "Not all bit positions for UART2 are the same as for UART0"
 #endif
-#if defined(TXC3) && (TXC3 != TXC0 || RXEN3 != RXEN0 || RXCIE3 != RXCIE0 || \
+#if defined(TXC3) && (TXC3 != TXC0 || RXC3 != RXC0 || RXEN3 != RXEN0 || RXCIE3 != RXCIE0 || TXCIE3 != TXCIE0 || \
           UDRIE3 != UDRIE0 || U3X3 != U3X0 || UPE3 != UPE0 || \
-          UDRE3 != UDRE0)
+          UDRE3 != UDRE0 || FE3 != FE0 || DOR3 != DOR0 || \
+          UCSZ32 != UCSZ02 || RXB83 != RXB80 || TXB83 != TXB80 || \
+          MPCM3 != MPCM0)
 #error "Not all bit positions for UART3 are the same as for UART0"
 #endif
 
+// Pin input register and mask of each RXD pin, passed to the constructor
+// so beginAuto() can time the sync character. Ports without an entry here
+// can't detect the baud rate.
+#if defined(__AVR_ATmega64__) || defined(__AVR_ATmega128__) || defined(__AVR_ATmega1281__) || defined(__AVR_ATmega2561__) \
+|| defined(__AVR_ATmega640__) || defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+  #define SERIAL0_RX_PIN &PINE, _BV(0)
+  #define SERIAL1_RX_PIN &PIND, _BV(2)
+  #if defined(__AVR_ATmega640__) || defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+    #define SERIAL2_RX_PIN &PINH, _BV(0)
+    #define SERIAL3_RX_PIN &PINJ, _BV(0)
+  #endif
+#elif defined(__AVR_ATmega164A__) || defined(__AVR_ATmega164P__) || defined(__AVR_ATmega324A__) \
+|| defined(__AVR_ATmega324P__) || defined(__AVR_ATmega324PA__) || defined(__AVR_ATmega324PB__) \
+|| defined(__AVR_ATmega644__) || defined(__AVR_ATmega644P__) || defined(__AVR_ATmega1284__) \
+|| defined(__AVR_ATmega1284P__)
+  #define SERIAL0_RX_PIN &PIND, _BV(0)
+  #define SERIAL1_RX_PIN &PIND, _BV(2)
+#elif defined(__AVR_ATmega162__)
+  #define SERIAL0_RX_PIN &PIND, _BV(0)
+  #define SERIAL1_RX_PIN &PINB, _BV(2)
+#elif defined(__AVR_ATmega328PB__)
+  #define SERIAL0_RX_PIN &PIND, _BV(0)
+  #define SERIAL1_RX_PIN &PINB, _BV(4)
+#else
+  #define SERIAL0_RX_PIN &PIND, _BV(0)
+#endif
+#if !defined(SERIAL1_RX_PIN)
+  #define SERIAL1_RX_PIN 0, 0
+#endif
+#if !defined(SERIAL2_RX_PIN)
+  #define SERIAL2_RX_PIN 0, 0
+#endif
+#if !defined(SERIAL3_RX_PIN)
+  #define SERIAL3_RX_PIN 0, 0
+#endif
+
 // Constructors ////////////////////////////////////////////////////////////////
 
 HardwareSerial::HardwareSerial(
   volatile uint8_t *ubrrh, volatile uint8_t *ubrrl,
   volatile uint8_t *ucsra, volatile uint8_t *ucsrb,
-  volatile uint8_t *ucsrc, volatile uint8_t *udr) :
+  volatile uint8_t *ucsrc, volatile uint8_t *udr,
+  volatile uint8_t *rxpin, uint8_t rxmask) :
     _ubrrh(ubrrh), _ubrrl(ubrrl),
     _ucsra(ucsra), _ucsrb(ucsrb), _ucsrc(ucsrc),
     _udr(udr),
+    _rxpin(rxpin), _rxmask(rxmask),
+    _baud(0), _baud_setting(0),
+    _de_port(0),
+    _tx_complete_callback(0),
+    _tx_idle(true),
+    _write_blocking(true),
+    _frame_mode(SERIAL_FRAME_NONE),
+    _frame_fill(0),
+    _frame_queue_head(0), _frame_queue_tail(0)
+#if defined(SERIAL_ENABLE_9BIT)
+    , _nine_bit(false), _mpcm(false)
+#endif
+{
+#if defined(SERIAL_ENABLE_STATS)
+  memset(&_stats, 0, sizeof(_stats));
+#endif
+}
+
+template<unsigned int RX_BUFFER_SIZE, unsigned int TX_BUFFER_SIZE>
+HardwareSerialT<RX_BUFFER_SIZE, TX_BUFFER_SIZE>::HardwareSerialT(
+  volatile uint8_t *ubrrh, volatile uint8_t *ubrrl,
+  volatile uint8_t *ucsra, volatile uint8_t *ucsrb,
+  volatile uint8_t *ucsrc, volatile uint8_t *udr,
+  volatile uint8_t *rxpin, uint8_t rxmask) :
+    HardwareSerial(ubrrh, ubrrl, ucsra, ucsrb, ucsrc, udr, rxpin, rxmask),
     _rx_buffer_head(0), _rx_buffer_tail(0),
     _tx_buffer_head(0), _tx_buffer_tail(0)
 {
 }
 
+// Drive the RS-485 driver enable pin, if there is one. Only called with
+// interrupts disabled, since the port register is shared with other pins.
+void HardwareSerial::_de_assert(void)
+{
+  if (_de_port)
+    *_de_port = (*_de_port & ~_de_mask) | _de_on;
+}
+
+void HardwareSerial::_de_release(void)
+{
+  if (_de_port)
+    *_de_port = (*_de_port & ~_de_mask) | (_de_on ^ _de_mask);
+}
+
+// Write a byte straight to the data register from outside the interrupt
+// handlers. Whenever the transmit complete interrupt can be enabled this
+// has to be atomic. Otherwise, if another interrupt held us up for a whole
+// character, its handler could release the driver enable pin just after
+// it was asserted for this byte, or set _tx_idle before we clear it, which
+// leaves flush() waiting for good. _tx_udr_empty_irq() only ever runs with
+// interrupts disabled.
+void HardwareSerial::_tx_direct(uint8_t c)
+{
+  if (_de_port || _tx_complete_callback) {
+    uint8_t oldSREG = SREG;
+    cli();
+    _de_assert();
+    *_udr = c;
+    sbi(*_ucsra, TXC0);
+    _tx_idle = false;
+    SREG = oldSREG;
+  } else {
+    *_udr = c;
+    sbi(*_ucsra, TXC0);
+    _tx_idle = false;
+  }
+}
+
 // Actual interrupt handlers //////////////////////////////////////////////////////////////
 
-void HardwareSerial::_rx_complete_irq(void)
+template<unsigned int RX_BUFFER_SIZE, unsigned int TX_BUFFER_SIZE>
+void HardwareSerialT<RX_BUFFER_SIZE, TX_BUFFER_SIZE>::_rx_complete_irq(void)
 {
+#if defined(SERIAL_ENABLE_STATS)
+  // The error flags are only valid until UDR is read
+  uint8_t status = *_ucsra;
+  if (status & _BV(FE0))
+    _stats.frame_errors++;
+  if (status & _BV(DOR0))
+    _stats.data_overruns++;
+#endif
+
   if (bit_is_clear(*_ucsra, UPE0)) {
     // No Parity error, read byte and store it in the buffer if there is
     // room
+#if defined(SERIAL_ENABLE_9BIT)
+    // RXB8 is only valid until UDR is read
+    bool bit8 = bit_is_set(*_ucsrb, RXB80);
+#endif
     unsigned char c = *_udr;
-    rx_buffer_index_t i = (unsigned int)(_rx_buffer_head + 1) % SERIAL_RX_BUFFER_SIZE;
+#if defined(SERIAL_ENABLE_9BIT)
+    if (_mpcm && bit8) {
+      // Address frame. Only let the data frames that follow through if
+      // they are meant for us. Writing 0 to TXC leaves the flag alone.
+      *_ucsra = (*_ucsra & _BV(U2X0)) | (c == _mpcm_address ? 0 : _BV(MPCM0));
+      return;
+    }
+#endif
+    rx_index_t i = (unsigned int)(_rx_buffer_head + 1) % RX_BUFFER_SIZE;
 
     // if we should be storing the received character into the location
     // just before the tail (meaning that the head would advance to the
@@ -112,12 +256,459 @@ void HardwareSerial::_rx_complete_irq(void)
     // and so we don't write the character or advance the head.
     if (i != _rx_buffer_tail) {
       _rx_buffer[_rx_buffer_head] = c;
+#if defined(SERIAL_ENABLE_9BIT)
+      if (_nine_bit) {
+        uint8_t mask = _BV(_rx_buffer_head & 7);
+        if (bit8)
+          _rx_bit8[_rx_buffer_head >> 3] |= mask;
+        else
+          _rx_bit8[_rx_buffer_head >> 3] &= ~mask;
+      }
+#endif
       _rx_buffer_head = i;
+
+      // In frame mode, remember where the frame ends. If the application
+      // doesn't keep up and the frame queue is full, the boundary is lost
+      // and this frame is merged with the next one.
+      if (_frame_mode != SERIAL_FRAME_NONE) {
+        bool end;
+        if (_frame_mode == SERIAL_FRAME_DELIMITER)
+          end = (c == _frame_delimiter);
+        else
+          end = (++_frame_fill == _frame_length);
+        if (end) {
+          uint8_t q = (_frame_queue_head + 1) % SERIAL_RX_FRAME_QUEUE_SIZE;
+          _frame_fill = 0;
+          if (q != _frame_queue_tail) {
+            _frame_end[_frame_queue_head] = i;
+            _frame_queue_head = q;
+          }
+        }
+      }
+
+#if defined(SERIAL_ENABLE_STATS)
+      uint16_t used = (unsigned int)(RX_BUFFER_SIZE + i - _rx_buffer_tail) % RX_BUFFER_SIZE;
+      if (used > _stats.rx_high_water)
+        _stats.rx_high_water = used;
+    } else {
+      _stats.rx_buffer_drops++;
+#endif
     }
   } else {
     // Parity error, read byte but discard it
     *_udr;
+#if defined(SERIAL_ENABLE_STATS)
+    _stats.parity_errors++;
+#endif
   };
 }
 
+#if defined(SERIAL_ENABLE_STATS)
+template<unsigned int RX_BUFFER_SIZE, unsigned int TX_BUFFER_SIZE>
+void HardwareSerialT<RX_BUFFER_SIZE, TX_BUFFER_SIZE>::_tx_high_water(tx_index_t head)
+{
+  uint16_t used = (unsigned int)(TX_BUFFER_SIZE + head - _tx_buffer_tail) % TX_BUFFER_SIZE;
+  if (used > _stats.tx_high_water)
+    _stats.tx_high_water = used;
+}
+#endif
+
+template<unsigned int RX_BUFFER_SIZE, unsigned int TX_BUFFER_SIZE>
+void HardwareSerialT<RX_BUFFER_SIZE, TX_BUFFER_SIZE>::_tx_udr_empty_irq(void)
+{
+  // If interrupts are enabled, there must be more data in the output
+  // buffer. Send the next byte
+  unsigned char c = _tx_buffer[_tx_buffer_tail];
+#if defined(SERIAL_ENABLE_9BIT)
+  // TXB8 has to be set up before UDR is written
+  if (_nine_bit) {
+    if (_tx_bit8[_tx_buffer_tail >> 3] & _BV(_tx_buffer_tail & 7))
+      sbi(*_ucsrb, TXB80);
+    else
+      cbi(*_ucsrb, TXB80);
+  }
+#endif
+  _tx_buffer_tail = (_tx_buffer_tail + 1) % TX_BUFFER_SIZE;
+
+  _de_assert();
+  *_udr = c;
+
+  // clear the TXC bit -- "can be cleared by writing a one to its bit
+  // location". This makes sure flush() won't return until the bytes
+  // actually got written
+  sbi(*_ucsra, TXC0);
+  _tx_idle = false;
+
+  if (_tx_buffer_head == _tx_buffer_tail) {
+    // Buffer empty, so disable interrupts
+    cbi(*_ucsrb, UDRIE0);
+  }
+}
+
+// Public Methods //////////////////////////////////////////////////////////////
+
+template<unsigned int RX_BUFFER_SIZE, unsigned int TX_BUFFER_SIZE>
+int HardwareSerialT<RX_BUFFER_SIZE, TX_BUFFER_SIZE>::available(void)
+{
+  return ((unsigned int)(RX_BUFFER_SIZE + _rx_buffer_head - _rx_buffer_tail)) % RX_BUFFER_SIZE;
+}
+
+template<unsigned int RX_BUFFER_SIZE, unsigned int TX_BUFFER_SIZE>
+int HardwareSerialT<RX_BUFFER_SIZE, TX_BUFFER_SIZE>::peek(void)
+{
+  if (_rx_buffer_head == _rx_buffer_tail) {
+    return -1;
+  } else {
+    return _rx_buffer[_rx_buffer_tail];
+  }
+}
+
+template<unsigned int RX_BUFFER_SIZE, unsigned int TX_BUFFER_SIZE>
+int HardwareSerialT<RX_BUFFER_SIZE, TX_BUFFER_SIZE>::read(void)
+{
+  // if the head isn't ahead of the tail, we don't have any characters
+  if (_rx_buffer_head == _rx_buffer_tail) {
+    return -1;
+  } else {
+    unsigned char c = _rx_buffer[_rx_buffer_tail];
+    _rx_advance((rx_index_t)(_rx_buffer_tail + 1) % RX_BUFFER_SIZE, 1);
+    return c;
+  }
+}
+
+template<unsigned int RX_BUFFER_SIZE, unsigned int TX_BUFFER_SIZE>
+int HardwareSerialT<RX_BUFFER_SIZE, TX_BUFFER_SIZE>::readAvailable(uint8_t *buffer, size_t size)
+{
+  rx_index_t head, tail = _rx_buffer_tail;
+  if (RX_BUFFER_SIZE > 256) {
+    uint8_t oldSREG = SREG;
+    cli();
+    head = _rx_buffer_head;
+    SREG = oldSREG;
+  } else {
+    head = _rx_buffer_head;
+  }
+
+  // Bytes that arrive in the meantime are left for the next call
+  size_t n = (unsigned int)(RX_BUFFER_SIZE + head - tail) % RX_BUFFER_SIZE;
+  if (n > size)
+    n = size;
+  _rx_copy(buffer, tail, n);
+  _rx_advance((rx_index_t)(tail + n) % RX_BUFFER_SIZE, n);
+  return n;
+}
+
+// Copies count bytes from the RX buffer, starting at tail, in at most two
+// contiguous spans, one up to the end of the buffer and one after
+// wrapping around
+template<unsigned int RX_BUFFER_SIZE, unsigned int TX_BUFFER_SIZE>
+void HardwareSerialT<RX_BUFFER_SIZE, TX_BUFFER_SIZE>::_rx_copy(uint8_t *buffer, rx_index_t tail, size_t count)
+{
+  while (count) {
+    size_t chunk = RX_BUFFER_SIZE - tail;
+    if (chunk > count)
+      chunk = count;
+    memcpy(buffer, &_rx_buffer[tail], chunk);
+    buffer += chunk;
+    count -= chunk;
+    tail = 0;
+  }
+}
+
+// Moves the RX tail count bytes forward, to tail. Frame ends the tail
+// reaches are dropped, so frames consumed with read() or readAvailable()
+// don't stay queued and keep frameAvailable() and serialEvent() going.
+// The queue is trimmed before the tail moves: until then, the interrupt
+// handler can't add frame ends that look like they are within reach.
+template<unsigned int RX_BUFFER_SIZE, unsigned int TX_BUFFER_SIZE>
+void HardwareSerialT<RX_BUFFER_SIZE, TX_BUFFER_SIZE>::_rx_advance(rx_index_t tail, size_t count)
+{
+  rx_index_t old = _rx_buffer_tail;
+  uint8_t q = _frame_queue_tail;
+  while (q != _frame_queue_head &&
+         (unsigned int)(RX_BUFFER_SIZE + _frame_end[q] - old) % RX_BUFFER_SIZE <= count)
+    q = (q + 1) % SERIAL_RX_FRAME_QUEUE_SIZE;
+  _frame_queue_tail = q;
+  _rx_buffer_tail = tail;
+}
+
+template<unsigned int RX_BUFFER_SIZE, unsigned int TX_BUFFER_SIZE>
+int HardwareSerialT<RX_BUFFER_SIZE, TX_BUFFER_SIZE>::readFrame(uint8_t *buffer, size_t size)
+{
+  if (!frameAvailable())
+    return -1;
+
+  // read() and readAvailable() drop the frame ends they pass, so the
+  // oldest one always lies between the tail and the head
+  rx_index_t tail = _rx_buffer_tail;
+  rx_index_t end = _frame_end[_frame_queue_tail];
+  size_t len = (unsigned int)(RX_BUFFER_SIZE + end - tail) % RX_BUFFER_SIZE;
+  _rx_copy(buffer, tail, len > size ? size : len);
+
+  // Drop whatever didn't fit in the buffer, along with this frame end
+  _rx_advance(end, len);
+  return len > size ? size : len;
+}
+
+template<unsigned int RX_BUFFER_SIZE, unsigned int TX_BUFFER_SIZE>
+int HardwareSerialT<RX_BUFFER_SIZE, TX_BUFFER_SIZE>::availableForWrite(void)
+{
+  tx_index_t head, tail;
+  if (TX_BUFFER_SIZE > 256) {
+    uint8_t oldSREG = SREG;
+    cli();
+    head = _tx_buffer_head;
+    tail = _tx_buffer_tail;
+    SREG = oldSREG;
+  } else {
+    head = _tx_buffer_head;
+    tail = _tx_buffer_tail;
+  }
+  if (head >= tail) return TX_BUFFER_SIZE - 1 - head + tail;
+  return tail - head - 1;
+}
+
+// Returns true while data is queued or still being shifted out
+template<unsigned int RX_BUFFER_SIZE, unsigned int TX_BUFFER_SIZE>
+bool HardwareSerialT<RX_BUFFER_SIZE, TX_BUFFER_SIZE>::_tx_busy(void)
+{
+  if (bit_is_set(*_ucsrb, UDRIE0)) {
+    if (bit_is_clear(SREG, SREG_I) && bit_is_set(*_ucsra, UDRE0))
+      // Interrupts are globally disabled, but the DR empty
+      // interrupt should be enabled, so poll the DR empty flag to
+      // prevent deadlock
+      _tx_udr_empty_irq();
+    return true;
+  }
+  // When the transmit complete interrupt is enabled, its handler clears
+  // TXC and sets _tx_idle instead
+  return bit_is_clear(*_ucsra, TXC0) && !_tx_idle;
+}
+
+template<unsigned int RX_BUFFER_SIZE, unsigned int TX_BUFFER_SIZE>
+void HardwareSerialT<RX_BUFFER_SIZE, TX_BUFFER_SIZE>::flush()
+{
+  // If we have never written a byte, no need to flush. This special
+  // case is needed since there is no way to force the TXC (transmit
+  // complete) bit to 1 during initialization
+  if (!_written)
+    return;
+
+  while (_tx_busy())
+    ;
+  // If we get here, nothing is queued anymore (DRIE is disabled) and
+  // the hardware finished tranmission (TXC is set).
+}
+
+template<unsigned int RX_BUFFER_SIZE, unsigned int TX_BUFFER_SIZE>
+bool HardwareSerialT<RX_BUFFER_SIZE, TX_BUFFER_SIZE>::flush(unsigned long timeout)
+{
+  if (!_written)
+    return true;
+
+  unsigned long start = millis();
+  while (_tx_busy()) {
+    if (millis() - start >= timeout)
+      return false;
+  }
+  return true;
+}
+
+template<unsigned int RX_BUFFER_SIZE, unsigned int TX_BUFFER_SIZE>
+size_t HardwareSerialT<RX_BUFFER_SIZE, TX_BUFFER_SIZE>::write(uint8_t c)
+{
+#if defined(SERIAL_ENABLE_9BIT)
+  if (_nine_bit)
+    return write9(c);
+#endif
+  _written = true;
+  // If the buffer and the data register is empty, just write the byte
+  // to the data register and be done. This shortcut helps
+  // significantly improve the effective datarate at high (>
+  // 500kbit/s) bitrates, where interrupt overhead becomes a slowdown.
+  if (_tx_buffer_head == _tx_buffer_tail && bit_is_set(*_ucsra, UDRE0)) {
+    _tx_direct(c);
+    return 1;
+  }
+  tx_index_t i = (_tx_buffer_head + 1) % TX_BUFFER_SIZE;
+
+  // In non-blocking mode a full buffer means the byte is dropped. With
+  // interrupts disabled nothing empties the buffer, so if the data
+  // register is free, make room the way the blocking loop below does.
+  if (!_write_blocking && i == _tx_buffer_tail) {
+    if (bit_is_clear(SREG, SREG_I) && bit_is_set(*_ucsra, UDRE0))
+      _tx_udr_empty_irq();
+    if (i == _tx_buffer_tail) {
+      setWriteError();
+      return 0;
+    }
+  }
+
+  // If the output buffer is full, there's nothing for it other than to 
+  // wait for the interrupt handler to empty it a bit
+  while (i == _tx_buffer_tail) {
+    if (bit_is_clear(SREG, SREG_I)) {
+      // Interrupts are disabled, so we'll have to poll the data
+      // register empty flag ourselves. If it is set, pretend an
+      // interrupt has happened and call the handler to free up
+      // space for us.
+      if(bit_is_set(*_ucsra, UDRE0))
+        _tx_udr_empty_irq();
+    } else {
+      // nop, the interrupt handler will free up space for us
+    }
+  }
+
+  _tx_buffer[_tx_buffer_head] = c;
+  _tx_buffer_head = i;
+#if defined(SERIAL_ENABLE_STATS)
+  _tx_high_water(i);
+#endif
+
+  sbi(*_ucsrb, UDRIE0);
+  
+  return 1;
+}
+
+template<unsigned int RX_BUFFER_SIZE, unsigned int TX_BUFFER_SIZE>
+size_t HardwareSerialT<RX_BUFFER_SIZE, TX_BUFFER_SIZE>::write(const uint8_t *buffer, size_t size)
+{
+  size_t n = size;
+  if (size == 0)
+    return 0;
+#if defined(SERIAL_ENABLE_9BIT)
+  // The ninth bit of every byte has to be cleared, so go byte by byte
+  if (_nine_bit)
+    return Print::write(buffer, size);
+#endif
+
+  _written = true;
+  // Same shortcut as write(uint8_t): if nothing is queued and the data
+  // register is free, the first byte can go out directly
+  if (_tx_buffer_head == _tx_buffer_tail && bit_is_set(*_ucsra, UDRE0)) {
+    _tx_direct(*buffer++);
+    if (--size == 0)
+      return n;
+  }
+
+  while (size) {
+    tx_index_t head = _tx_buffer_head;
+    tx_index_t tail;
+
+    // Wait once per chunk (instead of once per byte) until there is room
+    // in the output buffer
+    while (true) {
+      if (TX_BUFFER_SIZE > 256) {
+        uint8_t oldSREG = SREG;
+        cli();
+        tail = _tx_buffer_tail;
+        SREG = oldSREG;
+      } else {
+        tail = _tx_buffer_tail;
+      }
+      if ((tx_index_t)((head + 1) % TX_BUFFER_SIZE) != tail)
+        break;
+      if (bit_is_clear(SREG, SREG_I) && bit_is_set(*_ucsra, UDRE0)) {
+        _tx_udr_empty_irq();
+      } else if (!_write_blocking) {
+        // Report how much of the buffer actually got queued
+        setWriteError();
+        return n - size;
+      }
+    }
+
+    // Largest contiguous free span starting at head. One slot always
+    // stays empty to tell a full buffer from an empty one.
+    size_t chunk;
+    if (head >= tail)
+      chunk = TX_BUFFER_SIZE - head - (tail == 0);
+    else
+      chunk = tail - head - 1;
+    if (chunk > size)
+      chunk = size;
+
+    memcpy(&_tx_buffer[head], buffer, chunk);
+    buffer += chunk;
+    size -= chunk;
+    _tx_buffer_head = (head + chunk) % TX_BUFFER_SIZE;
+#if defined(SERIAL_ENABLE_STATS)
+    _tx_high_water(_tx_buffer_head);
+#endif
+
+    sbi(*_ucsrb, UDRIE0);
+  }
+
+  return n;
+}
+
+#if defined(SERIAL_ENABLE_9BIT)
+template<unsigned int RX_BUFFER_SIZE, unsigned int TX_BUFFER_SIZE>
+int HardwareSerialT<RX_BUFFER_SIZE, TX_BUFFER_SIZE>::read9(void)
+{
+  if (_rx_buffer_head == _rx_buffer_tail)
+    return -1;
+
+  rx_index_t tail = _rx_buffer_tail;
+  int c = _rx_buffer[tail];
+  if (_rx_bit8[tail >> 3] & _BV(tail & 7))
+    c |= 0x100;
+  _rx_advance((rx_index_t)(tail + 1) % RX_BUFFER_SIZE, 1);
+  return c;
+}
+
+template<unsigned int RX_BUFFER_SIZE, unsigned int TX_BUFFER_SIZE>
+size_t HardwareSerialT<RX_BUFFER_SIZE, TX_BUFFER_SIZE>::write9(uint16_t c)
+{
+  _written = true;
+  // Same shortcut as write(), with TXB8 set up right before UDR is written
+  if (_tx_buffer_head == _tx_buffer_tail && bit_is_set(*_ucsra, UDRE0)) {
+    uint8_t oldSREG = SREG;
+    cli();
+    if (c & 0x100)
+      sbi(*_ucsrb, TXB80);
+    else
+      cbi(*_ucsrb, TXB80);
+    _tx_direct(c);
+    SREG = oldSREG;
+    return 1;
+  }
+  tx_index_t head = _tx_buffer_head;
+  tx_index_t i = (head + 1) % TX_BUFFER_SIZE;
+
+  if (!_write_blocking && i == _tx_buffer_tail) {
+    if (bit_is_clear(SREG, SREG_I) && bit_is_set(*_ucsra, UDRE0))
+      _tx_udr_empty_irq();
+    if (i == _tx_buffer_tail) {
+      setWriteError();
+      return 0;
+    }
+  }
+
+  while (i == _tx_buffer_tail) {
+    if (bit_is_clear(SREG, SREG_I) && bit_is_set(*_ucsra, UDRE0))
+      _tx_udr_empty_irq();
+  }
+
+  _tx_buffer[head] = c;
+  if (c & 0x100)
+    _tx_bit8[head >> 3] |= _BV(head & 7);
+  else
+    _tx_bit8[head >> 3] &= ~_BV(head & 7);
+  _tx_buffer_head = i;
+#if defined(SERIAL_ENABLE_STATS)
+  _tx_high_water(i);
+#endif
+
+  sbi(*_ucsrb, UDRIE0);
+
+  return 1;
+}
+#endif
+
+template<unsigned int RX_BUFFER_SIZE, unsigned int TX_BUFFER_SIZE>
+void HardwareSerialT<RX_BUFFER_SIZE, TX_BUFFER_SIZE>::_rx_buffer_clear(void)
+{
+  _rx_buffer_head = _rx_buffer_tail;
+}
+
 #endif // whole file
@@ -0,0 +1,165 @@
+/*
+  HardwareSerial_txc.cpp - Hardware serial library for Wiring
+  Copyright (c) 2006 Nicholas Zambetti.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "Arduino.h"
+#include "HardwareSerial.h"
+#include "HardwareSerial_private.h"
+
+// The transmit complete interrupt is only needed for the RS-485 driver
+// enable pin and onTxComplete(), so its handlers live in this file instead
+// of the port files. Sketches that use neither don't link it, and are free
+// to have their own ISR(USARTn_TX_vect). The handlers reach the ports
+// through a table filled in by _update_txcie(), so using one port here
+// doesn't pull in the others.
+
+#if defined(HAVE_HWSERIAL0) || defined(HAVE_HWSERIAL1) || defined(HAVE_HWSERIAL2) || defined(HAVE_HWSERIAL3)
+
+#if defined(UBRRH) && defined(UBRRL)
+  #define SERIAL0_UDR UDR
+#else
+  #define SERIAL0_UDR UDR0
+#endif
+
+// Port with its transmit complete interrupt enabled, by UART number
+static HardwareSerial *tx_complete_port[4];
+
+#if defined(HAVE_HWSERIAL0)
+#if defined(USART_TX_vect)
+ISR(USART_TX_vect)
+#elif defined(USART0_TX_vect)
+ISR(USART0_TX_vect)
+#elif defined(USART0_TXC_vect)
+ISR(USART0_TXC_vect)
+#elif defined(USART_TXC_vect)
+ISR(USART_TXC_vect)
+#else
+  #error "Don't know what the Transmit Complete vector is called for Serial"
+#endif
+{
+  tx_complete_port[0]->_tx_complete_irq();
+}
+#endif
+
+#if defined(HAVE_HWSERIAL1)
+#if defined(UART1_TX_vect)
+ISR(UART1_TX_vect)
+#elif defined(USART1_TX_vect)
+ISR(USART1_TX_vect)
+#elif defined(USART1_TXC_vect)
+ISR(USART1_TXC_vect)
+#else
+  #error "Don't know what the Transmit Complete vector is called for Serial1"
+#endif
+{
+  tx_complete_port[1]->_tx_complete_irq();
+}
+#endif
+
+#if defined(HAVE_HWSERIAL2)
+ISR(USART2_TX_vect)
+{
+  tx_complete_port[2]->_tx_complete_irq();
+}
+#endif
+
+#if defined(HAVE_HWSERIAL3)
+ISR(USART3_TX_vect)
+{
+  tx_complete_port[3]->_tx_complete_irq();
+}
+#endif
+
+void HardwareSerial::_tx_complete_irq(void)
+{
+  // Only enabled when needed. The shift register and the data register are
+  // both empty, and the data register empty interrupt has a higher
+  // priority, so nothing else is queued either. Its handler clears TXC, so
+  // this can't fire while a new byte is on its way out.
+  _tx_idle = true;
+  _de_release();
+  if (_tx_complete_callback)
+    _tx_complete_callback();
+}
+
+void HardwareSerial::setDriverEnablePin(uint8_t pin, bool active_high)
+{
+  uint8_t port = digitalPinToPort(pin);
+  if (port == NOT_A_PORT)
+    return;
+  uint8_t mask = digitalPinToBitMask(pin);
+
+  uint8_t oldSREG = SREG;
+  cli();
+  _de_port = portOutputRegister(port);
+  _de_mask = mask;
+  _de_on = active_high ? mask : 0;
+  // Start out released, the next transmission asserts the pin
+  _de_release();
+  *portModeRegister(port) |= mask;
+  _update_txcie();
+  SREG = oldSREG;
+}
+
+void HardwareSerial::clearDriverEnablePin(void)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  _de_release();
+  _de_port = 0;
+  _update_txcie();
+  SREG = oldSREG;
+}
+
+void HardwareSerial::onTxComplete(void (*callback)(void))
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  _tx_complete_callback = callback;
+  _update_txcie();
+  SREG = oldSREG;
+}
+
+// The transmit complete interrupt is only needed for the driver enable pin
+// and the completion callback. Only called with interrupts disabled.
+void HardwareSerial::_update_txcie(void)
+{
+#if defined(HAVE_HWSERIAL0)
+  if (_udr == &SERIAL0_UDR)
+    tx_complete_port[0] = this;
+#endif
+#if defined(HAVE_HWSERIAL1)
+  if (_udr == &UDR1)
+    tx_complete_port[1] = this;
+#endif
+#if defined(HAVE_HWSERIAL2)
+  if (_udr == &UDR2)
+    tx_complete_port[2] = this;
+#endif
+#if defined(HAVE_HWSERIAL3)
+  if (_udr == &UDR3)
+    tx_complete_port[3] = this;
+#endif
+
+  if (_de_port || _tx_complete_callback)
+    sbi(*_ucsrb, TXCIE0);
+  else
+    cbi(*_ucsrb, TXCIE0);
+}
+
+#endif // whole file
@@ -0,0 +1,139 @@
+/*
+  PinGroup.cpp - Read and write several pins as one value
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "Arduino.h"
+#include "PinGroup.h"
+
+PinGroup::PinGroup(const uint8_t *pins, uint8_t count, Port *ports, Segment *segments) :
+  _ports(ports),
+  _segments(segments),
+  _port_count(0),
+  _segment_count(0)
+{
+  if (count > 16)
+    count = 16;
+
+  for (uint8_t i = 0; i < count; i++)
+  {
+    uint8_t pin = pins[i];
+    uint8_t port = digitalPinToPort(pin);
+    if (pin >= NUM_DIGITAL_PINS || port == NOT_A_PIN)
+      continue;
+    uint8_t mask = digitalPinToBitMask(pin);
+    int8_t shift = -i;
+    for (uint8_t m = mask; m > 1; m >>= 1)
+      shift++;
+
+    volatile uint8_t *out = portOutputRegister(port);
+    uint8_t p = 0;
+    while (p < _port_count && _ports[p].out != out)
+      p++;
+    if (p == _port_count)
+    {
+      _ports[p].in = portInputRegister(port);
+      _ports[p].mode = portModeRegister(port);
+      _ports[p].out = out;
+      _ports[p].mask = 0;
+      _port_count++;
+    }
+    _ports[p].mask |= mask;
+
+    // Join a segment of the same port and shift, or insert a new one after
+    // the last segment of the port, so segments stay sorted by port
+    uint8_t s = 0;
+    while (s < _segment_count && _segments[s].port <= p && !(_segments[s].port == p && _segments[s].shift == shift))
+      s++;
+    if (s < _segment_count && _segments[s].port == p)
+    {
+      _segments[s].mask |= mask;
+      continue;
+    }
+    for (uint8_t j = _segment_count; j > s; j--)
+      _segments[j] = _segments[j - 1];
+    _segments[s].port = p;
+    _segments[s].mask = mask;
+    _segments[s].shift = shift;
+    _segment_count++;
+  }
+}
+
+void PinGroup::mode(uint8_t mode)
+{
+  for (uint8_t p = 0; p < _port_count; p++)
+  {
+    Port &port = _ports[p];
+    uint8_t oldSREG = SREG;
+    cli();
+    // Like pinMode(), anything but INPUT and INPUT_PULLUP is an output
+    if (mode == INPUT || mode == INPUT_PULLUP)
+    {
+      *port.mode &= ~port.mask;
+      if (mode == INPUT_PULLUP)
+        *port.out |= port.mask;
+      else
+        *port.out &= ~port.mask;
+    }
+    else
+      *port.mode |= port.mask;
+    SREG = oldSREG;
+  }
+}
+
+void PinGroup::write(uint16_t value)
+{
+  const Segment *s = _segments;
+  const Segment *end = _segments + _segment_count;
+
+  for (uint8_t p = 0; p < _port_count; p++)
+  {
+    uint8_t bits = 0;
+    for (; s != end && s->port == p; s++)
+    {
+      if (s->shift >= 0)
+        bits |= (uint8_t)(value << s->shift) & s->mask;
+      else
+        bits |= (uint8_t)(value >> -s->shift) & s->mask;
+    }
+
+    Port &port = _ports[p];
+    uint8_t oldSREG = SREG;
+    cli();
+    *port.out = (*port.out & ~port.mask) | bits;
+    SREG = oldSREG;
+  }
+}
+
+uint16_t PinGroup::read()
+{
+  uint16_t value = 0;
+  const Segment *s = _segments;
+  const Segment *end = _segments + _segment_count;
+
+  for (uint8_t p = 0; p < _port_count; p++)
+  {
+    uint8_t bits = *_ports[p].in;
+    for (; s != end && s->port == p; s++)
+    {
+      if (s->shift >= 0)
+        value |= (uint16_t)(bits & s->mask) >> s->shift;
+      else
+        value |= (uint16_t)(bits & s->mask) << -s->shift;
+    }
+  }
+  return value;
+}
@@ -0,0 +1,79 @@
+/*
+  PinGroup.h - Read and write several pins as one value
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef PinGroup_h
+#define PinGroup_h
+
+#include "Arduino.h"
+
+// Bit n of the value is pins[n]. The pins are sorted by port when the
+// group is created, and pins that keep the same distance between their
+// value bit and port bit are handled with a single shift. Writing the
+// value then takes one read-modify-write per port, so all pins of a port
+// change at the same time. Like FastPin, PWM isn't turned off.
+class PinGroup
+{
+  public:
+    struct Port
+    {
+      volatile uint8_t *in;
+      volatile uint8_t *mode;
+      volatile uint8_t *out;
+      uint8_t mask;
+    };
+
+    // Value bits that go to a port with the same shift
+    struct Segment
+    {
+      uint8_t port;  // Index into the ports
+      uint8_t mask;  // Port bits
+      int8_t shift;  // Port bit - value bit
+    };
+
+  private:
+    Port *_ports;
+    Segment *_segments;
+    uint8_t _port_count;
+    uint8_t _segment_count;
+
+  public:
+    // ports and segments need room for count entries each. count can be
+    // up to 16.
+    PinGroup(const uint8_t *pins, uint8_t count, Port *ports, Segment *segments);
+
+    void mode(uint8_t mode);
+    void write(uint16_t value);
+    uint16_t read();
+};
+
+// A PinGroup of PINS pins, with room for its port and segment lists built in
+template<uint8_t PINS>
+class PinGroupT : public PinGroup
+{
+  static_assert(PINS >= 1 && PINS <= 16, "A PinGroup has 1 to 16 pins");
+
+  private:
+    Port _port_list[PINS];
+    Segment _segment_list[PINS];
+
+  public:
+    PinGroupT(const uint8_t (&pins)[PINS]) :
+      PinGroup(pins, PINS, _port_list, _segment_list) {}
+};
+
+#endif
@@ -91,6 +91,10 @@ size_t Print::print(long n, int base)
   } else if (base == 10) {
     if (n < 0) {
       int t = print('-');
+      if (t == 0) {
+        setWriteError();
+        return 0;
+      }
       n = -n;
       return printNumber(n, 10) + t;
     }
@@ -246,22 +250,47 @@ size_t Print::printNumber(unsigned long n, uint8_t base)
     *--str = c < 10 ? c + '0' : c + 'A' - 10;
   } while(n);
 
-  return write(str);
+  // A non-blocking stream may accept only part of the number
+  size_t len = &buf[sizeof(buf) - 1] - str;
+  size_t written = write((const uint8_t *)str, len);
+  if (written < len)
+    setWriteError();
+  return written;
 }
 
 size_t Print::printFloat(double number, uint8_t digits) 
 { 
-  size_t n = 0;
-  
   if (isnan(number)) return print("nan");
   if (isinf(number)) return print("inf");
   if (number > 4294967040.0) return print ("ovf");  // constant determined empirically
   if (number <-4294967040.0) return print ("ovf");  // constant determined empirically
-  
+
+  // write_error is cleared so printFloatParts() can tell when one of the
+  // parts got truncated, then the previous error is restored
+  int prev_error = write_error;
+  write_error = 0;
+  size_t n = printFloatParts(number, digits);
+  if (!write_error)
+    write_error = prev_error;
+  return n;
+}
+
+size_t Print::printFloatParts(double number, uint8_t digits)
+{
+  size_t n = 0;
+
+  // Every part stops at the first truncated write, so a non-blocking
+  // stream never gets the remaining digits glued to a number that was
+  // cut short
+
   // Handle negative numbers
   if (number < 0.0)
   {
-     n += print('-');
+     if (print('-') == 0) {
+       setWriteError();
+       return n;
+     }
+     n++;
      number = -number;
   }
 
@@ -276,10 +305,16 @@ size_t Print::printFloat(double number, uint8_t digits)
   unsigned long int_part = (unsigned long)number;
   double remainder = number - (double)int_part;
   n += print(int_part);
+  if (write_error)
+    return n;
 
   // Print the decimal point, but only if there are digits beyond
   if (digits > 0) {
-    n += print('.'); 
+    if (print('.') == 0) {
+      setWriteError();
+      return n;
+    }
+    n++;
   }
 
   // Extract digits from the remainder one at a time
@@ -288,6 +323,8 @@ size_t Print::printFloat(double number, uint8_t digits)
     remainder *= 10.0;
     unsigned int toPrint = (unsigned int)(remainder);
     n += print(toPrint);
+    if (write_error)
+      return n;
     remainder -= toPrint; 
   } 
   
@@ -40,6 +40,7 @@ class Print
     int write_error;
     size_t printNumber(unsigned long, uint8_t);
     size_t printFloat(double, uint8_t);
+    size_t printFloatParts(double, uint8_t);
   protected:
     void setWriteError(int err = 1) { write_error = err; }
   public:
@@ -39,6 +39,18 @@ int Stream::timedRead()
   return -1;     // -1 indicates timeout
 }
 
+// default implementation: may be overridden
+int Stream::readAvailable(uint8_t *buffer, size_t size)
+{
+  size_t n = 0;
+  while (n < size) {
+    int c = read();
+    if (c < 0) break;
+    buffer[n++] = (uint8_t)c;
+  }
+  return n;
+}
+
 // private method to peek stream with timeout
 int Stream::timedPeek()
 {
@@ -203,10 +215,16 @@ size_t Stream::readBytes(char *buffer, size_t length)
 {
   size_t count = 0;
   while (count < length) {
+    // Take everything that is already buffered in one go, and only fall
+    // back to timedRead() when we have to wait for more data
+    int n = readAvailable((uint8_t *)buffer + count, length - count);
+    if (n > 0) {
+      count += n;
+      continue;
+    }
     int c = timedRead();
     if (c < 0) break;
-    *buffer++ = (char)c;
-    count++;
+    buffer[count++] = (char)c;
   }
   return count;
 }
@@ -221,7 +239,9 @@ size_t Stream::readBytesUntil(char terminator, char *buffer, size_t length)
   if (length < 1) return 0;
   size_t index = 0;
   while (index < length) {
-    int c = timedRead();
+    // Buffered bytes don't need the millis() bookkeeping of timedRead()
+    int c = read();
+    if (c < 0) c = timedRead();
     if (c < 0 || c == terminator) break;
     *buffer++ = (char)c;
     index++;
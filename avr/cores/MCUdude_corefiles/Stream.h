@@ -60,6 +60,11 @@ class Stream : public Print
     virtual int read() = 0;
     virtual int peek() = 0;
 
+    // copies up to size bytes that are already buffered, without waiting
+    // returns the number of bytes copied. Buffered streams can override this
+    // with a bulk copy, readBytes() uses it to skip the per byte timedRead()
+    virtual int readAvailable(uint8_t *buffer, size_t size);
+
     Stream() {_timeout=1000;}
 
 // parsing methods
@@ -32,6 +32,7 @@
 
 
 uint8_t analog_reference = DEFAULT;
+volatile pwm_channel_mask_t pwm_active_channels = 0;
 
 void analogReference(uint8_t mode)
 {
@@ -118,7 +119,8 @@ void analogWrite(uint8_t pin, int val)
   }
   else
   {
-    switch(digitalPinToTimer(pin))
+    uint8_t timer = digitalPinToTimer(pin);
+    switch(timer)
     {
       #if defined(TCCR0) && defined(COM01)
       case TIMER0:
@@ -303,7 +305,15 @@ void analogWrite(uint8_t pin, int val)
         } else {
           digitalWrite(pin, HIGH);
         }
+        return;
     }
+
+    // The channel is connected now, so digitalWrite() and digitalRead()
+    // have to turn it off again
+    uint8_t oldSREG = SREG;
+    cli();
+    pwm_active_channels |= pwmChannelBit(timer);
+    SREG = oldSREG;
   }
 }
 
@@ -138,6 +138,11 @@ static void turnOffPWM(uint8_t timer)
     case  TIMER5C:  cbi(TCCR5A, COM5C1);    break;
     #endif
   }
+
+  uint8_t oldSREG = SREG;
+  cli();
+  pwm_active_channels &= ~pwmChannelBit(timer);
+  SREG = oldSREG;
 }
 
 void digitalWrite(uint8_t pin, uint8_t val)
@@ -151,7 +156,7 @@ void digitalWrite(uint8_t pin, uint8_t val)
 
   // If the pin that support PWM output, we need to turn it off
   // before doing a digital write.
-  if (timer != NOT_ON_TIMER) turnOffPWM(timer);
+  if (timer != NOT_ON_TIMER && pwmChannelActive(timer)) turnOffPWM(timer);
 
   out = portOutputRegister(port);
 
@@ -177,8 +182,33 @@ int digitalRead(uint8_t pin)
 
   // If the pin that support PWM output, we need to turn it off
   // before getting a digital reading.
-  if (timer != NOT_ON_TIMER) turnOffPWM(timer);
+  if (timer != NOT_ON_TIMER && pwmChannelActive(timer)) turnOffPWM(timer);
 
   if (*portInputRegister(port) & bit) return HIGH;
   return LOW;
 }
+
+void digitalToggle(uint8_t pin)
+{
+  uint8_t timer = digitalPinToTimer(pin);
+  uint8_t bit = digitalPinToBitMask(pin);
+  uint8_t port = digitalPinToPort(pin);
+
+  if (port == NOT_A_PIN) return;
+
+  // If the pin that support PWM output, we need to turn it off
+  // before toggling it.
+  if (timer != NOT_ON_TIMER && pwmChannelActive(timer)) turnOffPWM(timer);
+
+#if defined(HAVE_PINX_TOGGLE)
+  // Writing a one to PINx toggles the pin, no need to disable interrupts
+  *portInputRegister(port) = bit;
+#else
+  volatile uint8_t *out = portOutputRegister(port);
+
+  uint8_t oldSREG = SREG;
+  cli();
+  *out ^= bit;
+  SREG = oldSREG;
+#endif
+}
@@ -74,3 +74,30 @@ void _portWrite(uint8_t port, uint8_t val)
   *portregister = val;
   SREG = oldSREG;
 }
+
+
+void _portToggle(uint8_t port, uint8_t mask)
+{
+#if defined(HAVE_PINX_TOGGLE)
+  volatile uint8_t *inputregister;
+
+  inputregister = portInputRegister(port);
+
+  if(inputregister == NULL) 
+    return;
+
+  *inputregister = mask;
+#else
+  volatile uint8_t *portregister;
+
+  portregister = portOutputRegister(port);
+
+  if(portregister == NULL) 
+    return;
+
+  uint8_t oldSREG = SREG;
+  cli();
+  *portregister ^= mask;
+  SREG = oldSREG;
+#endif
+}
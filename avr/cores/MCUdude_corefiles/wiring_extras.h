@@ -27,6 +27,7 @@
 void _portMode(uint8_t, uint8_t);
 uint8_t _portRead(uint8_t);
 void _portWrite(uint8_t, uint8_t);
+void _portToggle(uint8_t, uint8_t);
 static inline void pullup(uint8_t PIN) { digitalWrite(PIN, HIGH); }
 static inline void noPullup(uint8_t PIN) { digitalWrite(PIN, LOW); }
 
@@ -69,6 +70,20 @@ static inline void portWrite(uint8_t PORT, uint8_t VALUE)
     _portWrite(PORT, VALUE);
 }
 
+// Writing ones to PINx toggles those pins in one go. Older chips without
+// that feature fall back to flipping the bits in PORTx.
+static inline void portToggle(uint8_t, uint8_t) __attribute__((always_inline, unused));
+static inline void portToggle(uint8_t PORT, uint8_t MASK)
+{
+  PORT++;
+#if defined(HAVE_PINX_TOGGLE)
+  if(__builtin_constant_p(PORT))
+    *(portInputRegister(PORT)) = MASK;
+  else
+#endif
+    _portToggle(PORT, MASK);
+}
+
 
 /*************************************************************
  * Sleep
@@ -45,6 +45,26 @@ uint32_t countPulseASM(volatile uint8_t *port, uint8_t bit, uint8_t stateMask, u
 
 typedef void (*voidFuncPtr)(void);
 
+// The timer channels analogWrite() has connected to their pins, one bit
+// per TIMERxx number. digitalWrite() and digitalRead() only turn off PWM
+// on these, so PWM set up by other means isn't turned off by them.
+#if defined(TCCR5A) || defined(COM4D1)
+typedef uint32_t pwm_channel_mask_t;
+#else
+typedef uint16_t pwm_channel_mask_t;
+#endif
+extern volatile pwm_channel_mask_t pwm_active_channels;
+#define pwmChannelBit(timer) ((pwm_channel_mask_t)1 << (timer))
+
+static inline uint8_t pwmChannelActive(uint8_t timer) __attribute__((always_inline, unused));
+static inline uint8_t pwmChannelActive(uint8_t timer)
+{
+  // Most of the time no channel is active at all, which is quicker to see
+  // than the bit of a single channel
+  pwm_channel_mask_t active = pwm_active_channels;
+  return active && (active & pwmChannelBit(timer));
+}
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
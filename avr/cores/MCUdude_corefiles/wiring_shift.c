@@ -20,6 +20,7 @@
   Boston, MA  02111-1307  USA
 */
 
+#include <util/delay_basic.h>
 #include "wiring_private.h"
 
 uint8_t shiftIn(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder) {
@@ -51,3 +52,150 @@ void shiftOut(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t val)
     digitalWrite(clockPin, LOW);    
   }
 }
+
+// shiftOutBuffer() and shiftInBuffer() look the pins up once, instead of
+// for every bit, and move the bits with direct port access. With a clock
+// of 0 they run as fast as possible: the 8 bits are unrolled and
+// interrupts are disabled for one byte at a time, which gives about 1 MHz
+// at 16 MHz. Otherwise clock is the highest clock rate in Hz to use, and
+// interrupts stay enabled between the port writes.
+
+// Cycles per _delay_loop_2() iteration
+#define SHIFT_DELAY_LOOP_CYCLES 4
+
+#define SHIFT_OUT_BIT(m) \
+  if (b & (m)) *data |= dmask; else *data &= ~dmask; \
+  *clk |= cmask; \
+  *clk &= ~cmask;
+
+#define SHIFT_IN_BIT(m) \
+  *clk |= cmask; \
+  if (*data & dmask) b |= (m); \
+  *clk &= ~cmask;
+
+// The number of _delay_loop_2() iterations that make half a clock period,
+// or 0 when there is no time to wait at all
+static uint16_t shiftHalfPeriod(unsigned long clock)
+{
+  if (clock == 0)
+    return 0;
+  unsigned long loops = F_CPU / 2 / SHIFT_DELAY_LOOP_CYCLES / clock;
+  return loops > 0xffff ? 0xffff : loops;
+}
+
+// Changes one bit of a port register without a race with interrupts
+static inline void shiftWrite(volatile uint8_t *reg, uint8_t mask, uint8_t val)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  if (val)
+    *reg |= mask;
+  else
+    *reg &= ~mask;
+  SREG = oldSREG;
+}
+
+void shiftOutBuffer(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, const uint8_t *buf, size_t len, unsigned long clock)
+{
+  uint8_t dport = digitalPinToPort(dataPin);
+  uint8_t cport = digitalPinToPort(clockPin);
+  if (dport == NOT_A_PIN || cport == NOT_A_PIN)
+    return;
+
+  // Also turns off PWM on the pins
+  digitalWrite(clockPin, LOW);
+  digitalWrite(dataPin, LOW);
+
+  volatile uint8_t *data = portOutputRegister(dport);
+  volatile uint8_t *clk = portOutputRegister(cport);
+  uint8_t dmask = digitalPinToBitMask(dataPin);
+  uint8_t cmask = digitalPinToBitMask(clockPin);
+  uint16_t half = shiftHalfPeriod(clock);
+
+  while (len--)
+  {
+    uint8_t b = *buf++;
+
+    if (half)
+    {
+      for (uint8_t i = 0; i < 8; i++)
+      {
+        uint8_t m = bitOrder == LSBFIRST ? _BV(i) : _BV(7 - i);
+        shiftWrite(data, dmask, b & m);
+        _delay_loop_2(half);
+        shiftWrite(clk, cmask, HIGH);
+        _delay_loop_2(half);
+        shiftWrite(clk, cmask, LOW);
+      }
+      continue;
+    }
+
+    uint8_t oldSREG = SREG;
+    cli();
+    if (bitOrder == LSBFIRST)
+    {
+      SHIFT_OUT_BIT(0x01) SHIFT_OUT_BIT(0x02) SHIFT_OUT_BIT(0x04) SHIFT_OUT_BIT(0x08)
+      SHIFT_OUT_BIT(0x10) SHIFT_OUT_BIT(0x20) SHIFT_OUT_BIT(0x40) SHIFT_OUT_BIT(0x80)
+    }
+    else
+    {
+      SHIFT_OUT_BIT(0x80) SHIFT_OUT_BIT(0x40) SHIFT_OUT_BIT(0x20) SHIFT_OUT_BIT(0x10)
+      SHIFT_OUT_BIT(0x08) SHIFT_OUT_BIT(0x04) SHIFT_OUT_BIT(0x02) SHIFT_OUT_BIT(0x01)
+    }
+    SREG = oldSREG;
+  }
+}
+
+void shiftInBuffer(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t *buf, size_t len, unsigned long clock)
+{
+  uint8_t dport = digitalPinToPort(dataPin);
+  uint8_t cport = digitalPinToPort(clockPin);
+  if (dport == NOT_A_PIN || cport == NOT_A_PIN)
+    return;
+
+  // Also turns off PWM on the clock pin
+  digitalWrite(clockPin, LOW);
+
+  volatile uint8_t *data = portInputRegister(dport);
+  volatile uint8_t *clk = portOutputRegister(cport);
+  uint8_t dmask = digitalPinToBitMask(dataPin);
+  uint8_t cmask = digitalPinToBitMask(clockPin);
+  uint16_t half = shiftHalfPeriod(clock);
+
+  while (len--)
+  {
+    uint8_t b = 0;
+
+    if (half)
+    {
+      for (uint8_t i = 0; i < 8; i++)
+      {
+        uint8_t m = bitOrder == LSBFIRST ? _BV(i) : _BV(7 - i);
+        shiftWrite(clk, cmask, HIGH);
+        _delay_loop_2(half);
+        if (*data & dmask)
+          b |= m;
+        shiftWrite(clk, cmask, LOW);
+        _delay_loop_2(half);
+      }
+    }
+    else
+    {
+      uint8_t oldSREG = SREG;
+      cli();
+      if (bitOrder == LSBFIRST)
+      {
+        SHIFT_IN_BIT(0x01) SHIFT_IN_BIT(0x02) SHIFT_IN_BIT(0x04) SHIFT_IN_BIT(0x08)
+        SHIFT_IN_BIT(0x10) SHIFT_IN_BIT(0x20) SHIFT_IN_BIT(0x40) SHIFT_IN_BIT(0x80)
+      }
+      else
+      {
+        SHIFT_IN_BIT(0x80) SHIFT_IN_BIT(0x40) SHIFT_IN_BIT(0x20) SHIFT_IN_BIT(0x10)
+        SHIFT_IN_BIT(0x08) SHIFT_IN_BIT(0x04) SHIFT_IN_BIT(0x02) SHIFT_IN_BIT(0x01)
+      }
+      SREG = oldSREG;
+    }
+
+    *buf++ = b;
+  }
+}
@@ -30,6 +30,10 @@
 // available too.
 #define SPI_ATOMIC_VERSION 1
 
+// SPI_HAS_TRANSFER_ASYNC means SPI has transferAsync() and
+// transferAsyncActive()
+#define SPI_HAS_TRANSFER_ASYNC 1
+
 // Uncomment this line to add detection of mismatched begin/end transactions.
 // A mismatch occurs if other libraries fail to use SPI.endTransaction() for
 // each SPI.beginTransaction().  Connect an LED to this pin.  The LED will turn
@@ -258,6 +262,30 @@ public:
     while (!(SPSR & _BV(SPIF))) ;
     *p = SPDR;
   }
+  // Starts sending count bytes from txbuf and storing what comes back in
+  // rxbuf, and returns right away. The bytes are moved by the SPI
+  // interrupt, so the sketch can keep working meanwhile. Without txbuf,
+  // 0xFF is sent, and without rxbuf the received bytes are thrown away.
+  // The chip select pin, if given, is driven low now and high again after
+  // the last byte. The callback then runs from the interrupt, so keep it
+  // short; it may start the next transfer. Returns false if a transfer is
+  // still running, or if interrupts are disabled, since the transfer would
+  // never finish. beginTransaction() disables them when usingInterrupt()
+  // was given an interrupt it can't mask on its own, so in that case use
+  // transfer() instead. Call beginTransaction() first and don't use
+  // transfer() until this one is done. Each byte costs an interrupt, so
+  // this pays off at the lower SPI clocks.
+  inline static bool transferAsync(const void *txbuf, void *rxbuf, size_t count,
+    void (*callback)(void)) {
+    return transferAsync(txbuf, rxbuf, count, callback, 0xff);
+  }
+  static bool transferAsync(const void *txbuf, void *rxbuf, size_t count,
+    void (*callback)(void), uint8_t csPin);
+  // True until the last byte of an asynchronous transfer is received
+  inline static bool transferAsyncActive() { return asyncActive; }
+  // Called by the SPI interrupt, don't use
+  static void asyncIrq();
+
   // After performing a group of transfers and releasing the chip select
   // signal, this function allows others to access the SPI bus
   inline static void endTransaction(void) {
@@ -317,6 +345,14 @@ private:
   static uint8_t interruptMode; // 0=none, 1=mask, 2=global
   static uint8_t interruptMask; // which interrupts to mask
   static uint8_t interruptSave; // temp storage, to restore state
+  static volatile bool asyncActive;
+  static bool asyncInCallback; // the callback may start the next transfer
+  static const uint8_t *asyncTx;
+  static uint8_t *asyncRx;
+  static size_t asyncCount; // bytes still to receive
+  static void (*asyncCallback)(void);
+  static volatile uint8_t *asyncCsPort;
+  static uint8_t asyncCsMask;
   #ifdef SPI_TRANSACTION_MISMATCH_LED
   static uint8_t inTransactionFlag;
   #endif
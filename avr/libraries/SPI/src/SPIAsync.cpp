@@ -0,0 +1,92 @@
+/*
+ * Interrupt driven transfers for the SPI Master library for arduino.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either the GNU General Public License version 2
+ * or the GNU Lesser General Public License version 2.1, both as
+ * published by the Free Software Foundation.
+ */
+
+#include "SPI.h"
+
+// The SPI interrupt handler lives in this file, so it only ends up in
+// sketches that use transferAsync(). Sketches that run the SPI as a slave
+// and have their own handler still link (the library is linked as an
+// archive, see dot_a_linkage in library.properties).
+
+volatile bool SPIClass::asyncActive = false;
+bool SPIClass::asyncInCallback = false;
+const uint8_t *SPIClass::asyncTx;
+uint8_t *SPIClass::asyncRx;
+size_t SPIClass::asyncCount;
+void (*SPIClass::asyncCallback)(void);
+volatile uint8_t *SPIClass::asyncCsPort;
+uint8_t SPIClass::asyncCsMask;
+
+bool SPIClass::transferAsync(const void *txbuf, void *rxbuf, size_t count,
+  void (*callback)(void), uint8_t csPin)
+{
+  if (asyncActive || count == 0)
+    return false;
+  // With interrupts disabled, asyncIrq() wouldn't run until they are back
+  // on, and waiting for transferAsyncActive() would hang. The callback
+  // runs from the interrupt, so it is fine there.
+  if (bit_is_clear(SREG, SREG_I) && !asyncInCallback)
+    return false;
+
+  asyncTx = (const uint8_t *)txbuf;
+  asyncRx = (uint8_t *)rxbuf;
+  asyncCount = count;
+  asyncCallback = callback;
+  asyncCsPort = 0;
+  uint8_t port = csPin < NUM_DIGITAL_PINS ? digitalPinToPort(csPin) : NOT_A_PORT;
+  if (port != NOT_A_PORT) {
+    asyncCsPort = portOutputRegister(port);
+    asyncCsMask = digitalPinToBitMask(csPin);
+  }
+
+  uint8_t sreg = SREG;
+  noInterrupts();
+  if (asyncCsPort)
+    *asyncCsPort &= ~asyncCsMask;
+  // Reading SPSR and then SPDR clears a SPIF left over from transfer(),
+  // so the interrupt doesn't fire before the first byte is out
+  (void)SPSR;
+  (void)SPDR;
+  asyncActive = true;
+  SPCR |= _BV(SPIE);
+  SPDR = asyncTx ? *asyncTx++ : 0xff;
+  SREG = sreg;
+  return true;
+}
+
+void SPIClass::asyncIrq()
+{
+  if (--asyncCount) {
+    // Start the next byte first. The received byte stays in the read
+    // buffer until that one is complete.
+    SPDR = asyncTx ? *asyncTx++ : 0xff;
+    if (asyncRx)
+      *asyncRx++ = SPDR;
+    return;
+  }
+
+  if (asyncRx)
+    *asyncRx = SPDR;
+  else
+    (void)SPDR;
+  SPCR &= ~_BV(SPIE);
+  if (asyncCsPort)
+    *asyncCsPort |= asyncCsMask;
+  asyncActive = false;
+  if (asyncCallback) {
+    asyncInCallback = true;
+    asyncCallback();
+    asyncInCallback = false;
+  }
+}
+
+ISR(SPI_STC_vect)
+{
+  SPIClass::asyncIrq();
+}
@@ -0,0 +1,60 @@
+/*
+ SoftwareSerial benchmark
+
+ Echoes every byte received on the software serial port back out of it,
+ for each baud rate in the list below. The hardware serial port tells the
+ other end which baud rate is up next.
+
+ This sketch is meant to be run in simavr by ss_bench, which plays the
+ other end of the software serial line with exact bit timing and prints
+ the results. See README.md in the parent folder.
+
+ The circuit:
+ * RX is digital pin 2 (PD2)
+ * TX is digital pin 3 (PD3)
+
+ This example code is in the public domain.
+*/
+
+#include <SoftwareSerial.h>
+
+const long bauds[] = {
+  1200, 2400, 4800, 9600, 14400, 19200, 28800, 31250,
+  38400, 57600, 76800, 115200, 230400
+};
+
+SoftwareSerial softSerial(2, 3);
+
+void setup()
+{
+  Serial.begin(115200);
+
+  for (uint8_t i = 0; i < sizeof(bauds) / sizeof(bauds[0]); i++)
+  {
+    Serial.print(F("BAUD "));
+    Serial.println(bauds[i]);
+    Serial.flush();
+
+    softSerial.begin(bauds[i]);
+
+    // Echo until the other end has been quiet for 100 ms
+    unsigned long last = millis();
+    while (millis() - last < 100)
+    {
+      if (softSerial.available())
+      {
+        softSerial.write(softSerial.read());
+        last = millis();
+      }
+    }
+
+    softSerial.end();
+    Serial.println(F("END"));
+  }
+
+  Serial.println(F("DONE"));
+}
+
+void loop()
+{
+}
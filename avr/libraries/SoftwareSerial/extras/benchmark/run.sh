@@ -0,0 +1,44 @@
+#!/bin/sh
+# Builds the benchmark sketch for every ATmega328P clock in boards.txt,
+# runs it in simavr and prints the results as Markdown, headed by the
+# versions they were measured with.
+#
+# Usage: ./run.sh [extra compiler flags, e.g. -D_SS_TIMER_TX -D_SS_TIMER_RX]
+#        ./run.sh > RESULTS.md
+
+set -e
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+BOARDS="$HERE/../../../../boards.txt"
+FQBN_BASE="MiniCore:avr:328:variant=modelP,bootloader=no_bootloader"
+BUILD=$(mktemp -d)
+trap 'rm -rf "$BUILD"' EXIT
+
+cc -O2 -Wall -o "$BUILD/ss_bench" "$HERE/ss_bench.c" \
+  $(pkg-config --cflags --libs simavr 2>/dev/null || echo -lsimavr -lelf) -lm
+
+# The avr-gcc arduino-cli builds with
+COMPILER=$(arduino-cli compile --fqbn "$FQBN_BASE" --show-properties "$HERE/SoftwareSerialBenchmark" |
+  sed -n 's/^compiler\.path=//p')
+
+echo "# SoftwareSerial benchmark results"
+echo
+echo "* MiniCore: $(git -C "$HERE" describe --always --dirty 2>/dev/null || echo unknown)"
+echo "* avr-gcc: $("${COMPILER}avr-gcc" -dumpversion)"
+echo "* simavr: $(pkg-config --modversion simavr 2>/dev/null || echo unknown)"
+echo "* Compiler flags: ${*:-none}"
+echo
+
+echo "| F_CPU | Baud | Bytes | Bit errors | BER | Max TX edge error | Max IRQ off (cycles) |"
+echo "|------:|-----:|------:|-----------:|----:|------------------:|---------------------:|"
+
+# One clock menu entry per F_CPU, external clocks come first in boards.txt
+sed -n 's/^328\.menu\.clock\.\([^.]*\)\.build\.f_cpu=\([0-9]*\)L.*/\1 \2/p' "$BOARDS" |
+  sort -u -k2,2n |
+  while read -r clock f_cpu; do
+    out="$BUILD/$clock"
+    arduino-cli compile --fqbn "$FQBN_BASE,clock=$clock" \
+      --build-property "compiler.cpp.extra_flags=$*" \
+      --output-dir "$out" "$HERE/SoftwareSerialBenchmark" >/dev/null
+    "$BUILD/ss_bench" "$out/SoftwareSerialBenchmark.ino.elf" "$f_cpu"
+  done
@@ -0,0 +1,302 @@
+/*
+  ss_bench.c - simavr harness for the SoftwareSerial benchmark sketch
+
+  Runs SoftwareSerialBenchmark.ino.elf in simavr and plays the other end
+  of its software serial line. For every baud rate the sketch announces,
+  it sends pseudo random bytes to the RX pin (PD2) with exact bit timing,
+  decodes the echo from the TX pin (PD3) and prints one row of a Markdown
+  table with:
+
+  - the number of bit errors in the echoed data, and the bit error rate
+  - the worst distance of an echoed edge from its ideal position, in
+    percent of a bit time
+  - the longest stretch with interrupts disabled (including time spent in
+    interrupt handlers), which is the worst latency any other interrupt
+    would have seen
+
+  Usage: ss_bench <elf file> <F_CPU> [mcu]
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_io.h>
+#include <simavr/sim_cycle_timers.h>
+#include <simavr/avr_ioport.h>
+#include <simavr/avr_uart.h>
+
+#define BYTES_PER_BAUD 64
+#define MAX_SECONDS 120
+
+static avr_t *avr;
+static avr_irq_t *rx_pin;
+static unsigned long f_cpu;
+static int done;
+
+// Baud rate being tested, 0 between rates
+static unsigned long baud;
+static double bit_cycles;
+
+// Results for the current baud rate
+static int sent;
+static int bit_errors;
+static double max_edge_error;
+static avr_cycle_count_t irq_off_since;
+static avr_cycle_count_t max_irq_off;
+
+// Byte on its way to the sketch, and whether we wait for its echo
+static uint16_t send_frame;
+static int send_bit_index;
+static avr_cycle_count_t send_start;
+static avr_cycle_count_t next_send;
+static uint8_t expected;
+static int waiting;
+static avr_cycle_count_t deadline;
+static uint16_t lfsr = 0xace1;
+
+// Frame being decoded from the TX pin. echo_bit is the next data bit to
+// sample, or -1 while waiting for a start bit.
+static int line_level = 1;
+static int echo_bit = -1;
+static avr_cycle_count_t echo_start;
+static uint8_t echo_data;
+
+static char line[64];
+static size_t line_len;
+
+static uint8_t next_byte(void)
+{
+  // 16-bit Galois LFSR
+  lfsr = (lfsr >> 1) ^ (-(lfsr & 1u) & 0xb400u);
+  return lfsr;
+}
+
+static avr_cycle_count_t bit_time(avr_cycle_count_t start, double bits)
+{
+  return start + (avr_cycle_count_t)(bits * bit_cycles + 0.5);
+}
+
+static avr_cycle_count_t send_bit(avr_t *sim, avr_cycle_count_t when, void *param)
+{
+  (void)sim;
+  (void)when;
+  (void)param;
+  if (send_bit_index == 10)
+    return 0;
+  avr_raise_irq(rx_pin, (send_frame >> send_bit_index) & 1);
+  send_bit_index++;
+  return bit_time(send_start, send_bit_index);
+}
+
+static void send_byte(uint8_t b)
+{
+  // Start bit, 8 data bits and stop bit
+  send_frame = ((uint16_t)b << 1) | 0x200;
+  send_bit_index = 0;
+  send_start = avr->cycle + 1;
+  avr_cycle_timer_register(avr, 1, send_bit, NULL);
+
+  expected = b;
+  waiting = 1;
+  // Room for the byte, the echo and 1 ms in the sketch's loop
+  deadline = bit_time(send_start, 25) + f_cpu / 1000;
+}
+
+static void echo_received(uint8_t data, int stop_bit)
+{
+  if (!waiting)
+  {
+    // Nothing was sent, so all of it is wrong
+    bit_errors += 8;
+    return;
+  }
+  bit_errors += __builtin_popcount(data ^ expected) + !stop_bit;
+  waiting = 0;
+  next_send = bit_time(avr->cycle, 2);
+}
+
+static avr_cycle_count_t sample_bit(avr_t *sim, avr_cycle_count_t when, void *param)
+{
+  (void)sim;
+  (void)when;
+  (void)param;
+  if (echo_bit < 8)
+  {
+    if (line_level)
+      echo_data |= 1 << echo_bit;
+    echo_bit++;
+    return bit_time(echo_start, echo_bit + 1.5);
+  }
+  echo_received(echo_data, line_level);
+  echo_bit = -1;
+  return 0;
+}
+
+static void tx_pin_changed(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+  (void)irq;
+  (void)param;
+  int level = value ? 1 : 0;
+  if (level == line_level)
+    return;
+  line_level = level;
+  if (!baud)
+    return;
+
+  if (echo_bit < 0)
+  {
+    if (!level)
+    {
+      echo_start = avr->cycle;
+      echo_bit = 0;
+      echo_data = 0;
+      avr_cycle_timer_register(avr, bit_time(0, 1.5), sample_bit, NULL);
+    }
+    return;
+  }
+
+  // Every edge inside a frame should be a whole number of bits from the
+  // start bit
+  double pos = (avr->cycle - echo_start) / bit_cycles;
+  double error = fabs(pos - floor(pos + 0.5));
+  if (error > max_edge_error)
+    max_edge_error = error;
+}
+
+static void start_baud(unsigned long rate)
+{
+  baud = rate;
+  bit_cycles = (double)f_cpu / rate;
+  sent = 0;
+  bit_errors = 0;
+  max_edge_error = 0;
+  max_irq_off = 0;
+  irq_off_since = 0;
+  waiting = 0;
+  echo_bit = -1;
+  // Give begin() some time
+  next_send = avr->cycle + f_cpu / 500;
+}
+
+static void report(void)
+{
+  printf("| %lu | %lu | %d | %d | %.6f | %.1f%% | %llu |\n",
+    f_cpu, baud, sent, bit_errors, bit_errors / (8.0 * sent),
+    max_edge_error * 100, (unsigned long long)max_irq_off);
+  fflush(stdout);
+  baud = 0;
+}
+
+static void uart_output(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+  (void)irq;
+  (void)param;
+  char c = value;
+  if (c == '\r')
+    return;
+  if (c != '\n')
+  {
+    if (line_len < sizeof(line) - 1)
+      line[line_len++] = c;
+    return;
+  }
+  line[line_len] = 0;
+  line_len = 0;
+
+  if (!strncmp(line, "BAUD ", 5))
+    start_baud(strtoul(line + 5, NULL, 10));
+  else if (!strcmp(line, "END"))
+    report();
+  else if (!strcmp(line, "DONE"))
+    done = 1;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 3)
+  {
+    fprintf(stderr, "Usage: %s <elf file> <F_CPU> [mcu]\n", argv[0]);
+    return 1;
+  }
+  f_cpu = strtoul(argv[2], NULL, 10);
+  const char *mcu = argc > 3 ? argv[3] : "atmega328p";
+
+  elf_firmware_t firmware;
+  memset(&firmware, 0, sizeof(firmware));
+  if (elf_read_firmware(argv[1], &firmware))
+  {
+    fprintf(stderr, "Can't read %s\n", argv[1]);
+    return 1;
+  }
+  avr = avr_make_mcu_by_name(mcu);
+  if (!avr)
+  {
+    fprintf(stderr, "Unknown mcu %s\n", mcu);
+    return 1;
+  }
+  avr_init(avr);
+  avr->frequency = f_cpu;
+  avr_load_firmware(avr, &firmware);
+
+  // Keep the UART off stdout, the table goes there
+  uint32_t flags = 0;
+  avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+  flags &= ~AVR_UART_FLAG_STDIO;
+  avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+  avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT),
+    uart_output, NULL);
+
+  rx_pin = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 2);
+  avr_raise_irq(rx_pin, 1);
+  avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 3),
+    tx_pin_changed, NULL);
+
+  while (!done && avr->cycle < (avr_cycle_count_t)MAX_SECONDS * f_cpu)
+  {
+    int state = avr_run(avr);
+    if (state == cpu_Done || state == cpu_Crashed)
+      break;
+    if (!baud)
+      continue;
+
+    if (!avr->sreg[S_I])
+    {
+      if (!irq_off_since)
+        irq_off_since = avr->cycle;
+    }
+    else if (irq_off_since)
+    {
+      if (avr->cycle - irq_off_since > max_irq_off)
+        max_irq_off = avr->cycle - irq_off_since;
+      irq_off_since = 0;
+    }
+
+    if (waiting && avr->cycle > deadline)
+    {
+      // No echo at all
+      bit_errors += 8;
+      waiting = 0;
+      next_send = avr->cycle;
+    }
+    if (!waiting && sent < BYTES_PER_BAUD && avr->cycle >= next_send)
+    {
+      send_byte(next_byte());
+      sent++;
+    }
+  }
+
+  if (!done)
+  {
+    fprintf(stderr, "%s stopped before the sketch finished\n", argv[1]);
+    return 1;
+  }
+  return 0;
+}
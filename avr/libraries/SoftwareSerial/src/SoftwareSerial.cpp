@@ -44,15 +44,55 @@ http://arduiniana.org.
 #include <avr/pgmspace.h>
 #include <Arduino.h>
 #include <SoftwareSerial.h>
-#include <util/delay_basic.h>
 
 //
 // Statics
 //
+#if defined(_SS_TIMER_RX)
+SoftwareSerial *SoftwareSerial::listeners[_SS_MAX_LISTENERS];
+#else
 SoftwareSerial *SoftwareSerial::active_object = 0;
-uint8_t SoftwareSerial::_receive_buffer[_SS_MAX_RX_BUFF]; 
-volatile uint8_t SoftwareSerial::_receive_buffer_tail = 0;
-volatile uint8_t SoftwareSerial::_receive_buffer_head = 0;
+#endif
+
+#if (_SS_MAX_RX_BUFF & (_SS_MAX_RX_BUFF - 1)) || _SS_MAX_RX_BUFF > 256
+#error "_SS_MAX_RX_BUFF must be a power of two, up to 256"
+#endif
+#if defined(_SS_TIMER_TX)
+SoftwareSerial * volatile SoftwareSerial::tx_active_object = 0;
+uint16_t SoftwareSerial::tx_frame;
+
+#if (_SS_MAX_TX_BUFF & (_SS_MAX_TX_BUFF - 1)) || _SS_MAX_TX_BUFF > 256
+#error "_SS_MAX_TX_BUFF must be a power of two, up to 256"
+#endif
+
+// Timer1 cycles a new compare value has to be ahead of TCNT1, so it can't
+// be passed before it is written
+#define SS_TX_MIN_AHEAD 16
+#endif
+
+#if defined(INT_ONLY) || defined(INT_AND_PCINT)
+// External interrupt mask register, used by setRxIntMsk() on pins without
+// a pin change interrupt
+#if defined(EIMSK)
+  #define SS_EIMSK EIMSK
+#elif defined(GICR)
+  #define SS_EIMSK GICR
+#elif defined(GIMSK)
+  #define SS_EIMSK GIMSK
+#endif
+#endif
+
+#if defined(_SS_TIMER1)
+// Timer1 interrupt registers are shared with the other timers on the
+// older chips
+#if defined(TIMSK1)
+  #define SS_TIMSK TIMSK1
+  #define SS_TIFR TIFR1
+#else
+  #define SS_TIMSK TIMSK
+  #define SS_TIFR TIFR
+#endif
+#endif
 
 //
 // Debugging
@@ -79,16 +119,81 @@ inline void DebugPulse(uint8_t, uint8_t) {}
 // Private methods
 //
 
+// Waits 4 * delay.loops + delay.extra + 5 cycles, not counting the code
+// the compiler puts around it to load the operands. Each sbrc
+// skips its rjmp (2 cycles) when the bit is clear, and runs into it (3
+// cycles) when it is set. The loop takes 4 cycles per pass, minus one
+// for the last.
 /* static */ 
-inline void SoftwareSerial::tunedDelay(uint16_t delay) { 
-  _delay_loop_2(delay);
+inline void SoftwareSerial::tunedDelay(DelayCycles delay) { 
+  uint16_t loops = delay.loops;
+  asm volatile(
+    "sbrc %[extra], 0 \n\t"
+    "rjmp .+0 \n\t"
+    "sbrc %[extra], 1 \n\t"
+    "rjmp .+0 \n\t"
+    "sbrc %[extra], 1 \n\t"
+    "rjmp .+0 \n\t"
+    "1: sbiw %[loops], 1 \n\t"
+    "brne 1b \n\t"
+    : [loops] "=w" (loops)
+    : "0" (loops), [extra] "r" (delay.extra)
+  );
+}
+
+#if defined(_SS_TIMER_RX)
+// Adds this port to the listeners. Returns true if it wasn't listening
+// yet, false if it was or if all _SS_MAX_LISTENERS slots are taken.
+bool SoftwareSerial::listen()
+{
+  if (!_rx_bit_ticks || _listening)
+    return false;
+
+  for (uint8_t i = 0; i < _SS_MAX_LISTENERS; i++)
+  {
+    if (!listeners[i])
+    {
+      _rx_bit = 0;
+      _rx_level = 1;
+
+      uint8_t oldSREG = SREG;
+      cli();
+      listeners[i] = this;
+      SREG = oldSREG;
+      _listening = true;
+
+      if (!txDriving())
+        setRxIntMsk(true);
+      return true;
+    }
+  }
+  return false;
 }
 
+// Stop listening. Returns true if we were actually listening.
+bool SoftwareSerial::stopListening()
+{
+  if (!_listening)
+    return false;
+
+  // The pin change interrupt might be shared with other listeners, so
+  // take ourselves out of the list before it can fire again
+  setRxIntMsk(false);
+  uint8_t oldSREG = SREG;
+  cli();
+  for (uint8_t i = 0; i < _SS_MAX_LISTENERS; i++)
+    if (listeners[i] == this)
+      listeners[i] = NULL;
+  SREG = oldSREG;
+  _listening = false;
+  return true;
+}
+#else
 // This function sets the current object as the "listening"
 // one and returns true if it replaces another 
 bool SoftwareSerial::listen()
 {
-  if (!_rx_delay_stopbit)
+  if (!_rx_delay_stopbit.loops)
     return false;
 
   if (active_object != this)
@@ -96,11 +201,10 @@ bool SoftwareSerial::listen()
     if (active_object)
       active_object->stopListening();
 
-    _buffer_overflow = false;
-    _receive_buffer_head = _receive_buffer_tail = 0;
     active_object = this;
 
-    setRxIntMsk(true);
+    if (!txDriving())
+      setRxIntMsk(true);
     return true;
   }
 
@@ -118,6 +222,7 @@ bool SoftwareSerial::stopListening()
   }
   return false;
 }
+#endif
 
 //
 // The receive routine called by the interrupt handler
@@ -152,44 +257,64 @@ void SoftwareSerial::recv()
     // cause problems at higher baudrates.
     setRxIntMsk(false);
 
-    // Wait approximately 1/2 of a bit width to "center" the sample
-    tunedDelay(_rx_delay_centering);
+    // Wait approximately 1/2 of a bit width to "center" the sample, then
+    // read each of the 8 bits. This is written in assembly so the time
+    // between the samples doesn't depend on the compiler; setRxDelays()
+    // has the cycle counts. The delays work like tunedDelay(). A pass
+    // through the bit loop takes 4 * loops + extra + 15 cycles: the sbrc
+    // and rjmp pairs take 6 + extra, movw 1, the delay loop 4 * loops - 1,
+    // ld 2, lsr 1, and 1, breq and ori 2 either way, dec 1 and brne 2.
+    uint8_t i;
+    uint16_t cnt;
+    asm volatile(
+      "sbrc %[cextra], 0 \n\t"
+      "rjmp .+0 \n\t"
+      "sbrc %[cextra], 1 \n\t"
+      "rjmp .+0 \n\t"
+      "sbrc %[cextra], 1 \n\t"
+      "rjmp .+0 \n\t"
+      "movw %[cnt], %[cloops] \n\t"
+      "1: sbiw %[cnt], 1 \n\t"
+      "brne 1b \n\t"
+      "ldi %[i], 8 \n\t"
+      "clr %[d] \n\t"
+      "2: sbrc %[extra], 0 \n\t"
+      "rjmp .+0 \n\t"
+      "sbrc %[extra], 1 \n\t"
+      "rjmp .+0 \n\t"
+      "sbrc %[extra], 1 \n\t"
+      "rjmp .+0 \n\t"
+      "movw %[cnt], %[loops] \n\t"
+      "3: sbiw %[cnt], 1 \n\t"
+      "brne 3b \n\t"
+      "ld __tmp_reg__, %a[port] \n\t"
+      "lsr %[d] \n\t"
+      "and __tmp_reg__, %[mask] \n\t"
+      "breq 4f \n\t"
+      "ori %[d], 0x80 \n\t"
+      "4: dec %[i] \n\t"
+      "brne 2b \n\t"
+      : [d] "=&d" (d), [i] "=&d" (i), [cnt] "=&w" (cnt)
+      : [port] "e" (_receivePortRegister), [mask] "r" (_receiveBitMask),
+        [cloops] "r" (_rx_delay_centering.loops), [cextra] "r" (_rx_delay_centering.extra),
+        [loops] "r" (_rx_delay_intrabit.loops), [extra] "r" (_rx_delay_intrabit.extra)
+    );
     DebugPulse(_DEBUG_PIN2, 1);
 
-    // Read each of the 8 bits
-    for (uint8_t i=8; i > 0; --i)
-    {
-      tunedDelay(_rx_delay_intrabit);
-      d >>= 1;
-      DebugPulse(_DEBUG_PIN2, 1);
-      if (rx_pin_read())
-        d |= 0x80;
-    }
-
     if (_inverse_logic)
       d = ~d;
 
-    // if buffer full, set the overflow flag and return
-    uint8_t next = (_receive_buffer_tail + 1) % _SS_MAX_RX_BUFF;
-    if (next != _receive_buffer_head)
-    {
-      // save new data in buffer: tail points to where byte goes
-      _receive_buffer[_receive_buffer_tail] = d; // save new byte
-      _receive_buffer_tail = next;
-    } 
-    else 
-    {
-      DebugPulse(_DEBUG_PIN1, 1);
-      _buffer_overflow = true;
-    }
-
     // skip the stop bit
     tunedDelay(_rx_delay_stopbit);
     DebugPulse(_DEBUG_PIN1, 1);
 
-    // Re-enable interrupts when we're sure to be inside the stop bit
+    // Re-enable interrupts when we're sure to be inside the stop bit. The
+    // byte is stored after that, so rxStore() isn't part of the timing.
+    // Interrupts are still disabled globally, so an edge that comes in
+    // meantime is only handled after we return.
     setRxIntMsk(true);
 
+    rxStore(d);
   }
 
 #if GCC_VERSION < 40302
@@ -208,6 +333,86 @@ void SoftwareSerial::recv()
 #endif
 }
 
+void SoftwareSerial::rxStore(uint8_t d)
+{
+  // if buffer full, set the overflow flag and return
+  uint8_t next = (_receive_buffer_tail + 1) & _receive_buffer_mask;
+  if (next != _receive_buffer_head)
+  {
+    // save new data in buffer: tail points to where byte goes
+    _receive_buffer[_receive_buffer_tail] = d; // save new byte
+    _receive_buffer_tail = next;
+  } 
+  else 
+  {
+    DebugPulse(_DEBUG_PIN1, 1);
+    _buffer_overflow = true;
+  }
+}
+
+#if defined(_SS_TIMER_RX)
+// Called for every pin change on any listener's pin, with the Timer1 count
+// taken when the interrupt started
+void SoftwareSerial::rxEdge(uint16_t now)
+{
+  // Our own bytes on a half duplex bus, seen because another listener's
+  // pin shares the pin change interrupt
+  if (txDriving())
+    return;
+
+  uint8_t level = rx_pin_read() ? 1 : 0;
+  if (_inverse_logic)
+    level ^= 1;
+  // Another listener's pin changed
+  if (level == _rx_level)
+    return;
+  _rx_level = level;
+
+  // The line had the other level since the previous edge
+  if (_rx_bit)
+    rxFill(now, !level);
+
+  if (!_rx_bit && !level)
+  {
+    // Start bit. Data bit 1 is sampled one and a half bit times later.
+    _rx_start = now;
+    _rx_sample = _rx_bit_ticks + _rx_bit_ticks / 2;
+    _rx_bit = 1;
+
+    // Make sure the frame is completed even if it ends with ones, which
+    // leave no edge behind. The compare B interrupt is shared, so only
+    // move it if it isn't due earlier for another listener already.
+    uint16_t due = now + 9 * _rx_bit_ticks;
+    if (!(SS_TIMSK & _BV(OCIE1B)) || (uint16_t)(due - now) < (uint16_t)(OCR1B - now))
+    {
+      OCR1B = due;
+      SS_TIFR = _BV(OCF1B);
+      SS_TIMSK |= _BV(OCIE1B);
+    }
+  }
+}
+
+// Shifts in every data bit whose middle lies before now with the given
+// level, and stores the byte once all 8 are in
+void SoftwareSerial::rxFill(uint16_t now, uint8_t level)
+{
+  uint16_t elapsed = now - _rx_start;
+  while (elapsed >= _rx_sample)
+  {
+    _rx_data >>= 1;
+    if (level)
+      _rx_data |= 0x80;
+    _rx_sample += _rx_bit_ticks;
+    if (++_rx_bit > 8)
+    {
+      rxStore(_rx_data);
+      _rx_bit = 0;
+      break;
+    }
+  }
+}
+#endif
+
 uint8_t SoftwareSerial::rx_pin_read()
 {
   return *_receivePortRegister & _receiveBitMask;
@@ -225,6 +430,53 @@ static void isr()
 }
 #endif
 
+#if defined(_SS_TIMER_RX)
+/* static */
+inline void SoftwareSerial::handle_interrupt()
+{
+  uint16_t now = TCNT1;
+  for (uint8_t i = 0; i < _SS_MAX_LISTENERS; i++)
+  {
+    if (listeners[i])
+      listeners[i]->rxEdge(now);
+  }
+}
+
+ISR(TIMER1_COMPB_vect)
+{
+  SoftwareSerial::handle_rx_timeout();
+}
+
+// Completes frames that ended without an edge, and reschedules itself for
+// the listeners that are still in the middle of one
+/* static */
+inline void SoftwareSerial::handle_rx_timeout()
+{
+  uint16_t now = TCNT1;
+  uint16_t next = 0xffff;
+  bool pending = false;
+
+  for (uint8_t i = 0; i < _SS_MAX_LISTENERS; i++)
+  {
+    SoftwareSerial *s = listeners[i];
+    if (!s || !s->_rx_bit)
+      continue;
+    s->rxFill(now, s->_rx_level);
+    if (s->_rx_bit)
+    {
+      uint16_t left = s->_rx_start + 9 * s->_rx_bit_ticks - now;
+      if (left < next)
+        next = left;
+      pending = true;
+    }
+  }
+
+  if (pending)
+    OCR1B = now + next;
+  else
+    SS_TIMSK &= ~_BV(OCIE1B);
+}
+#else
 /* static */
 inline void SoftwareSerial::handle_interrupt()
 {
@@ -233,6 +485,7 @@ inline void SoftwareSerial::handle_interrupt()
     active_object->recv();
   }
 }
+#endif
 
 #if defined(PCINT0_vect)
 ISR(PCINT0_vect)
@@ -253,17 +506,121 @@ ISR(PCINT2_vect, ISR_ALIASOF(PCINT0_vect));
 ISR(PCINT3_vect, ISR_ALIASOF(PCINT0_vect));
 #endif
 
+#if defined(_SS_TIMER_TX)
+ISR(TIMER1_COMPA_vect)
+{
+  SoftwareSerial::handle_tx_interrupt();
+}
+
+/* static */
+inline void SoftwareSerial::handle_tx_interrupt()
+{
+  SoftwareSerial *s = tx_active_object;
+  uint16_t frame = tx_frame;
+
+  // Only the end marker is left once the stop bit has been sent
+  if (frame <= 1)
+  {
+    uint8_t tail = s->_transmit_buffer_tail;
+    if (tail == s->_transmit_buffer_head)
+    {
+      SS_TIMSK &= ~_BV(OCIE1A);
+      if (s->_half_duplex)
+        s->busRelease();
+      tx_active_object = NULL;
+      return;
+    }
+    // Start bit, 8 data bits, stop bit and the end marker
+    frame = ((uint16_t)s->_transmit_buffer[tail] << 1) | 0x200;
+    if (s->_inverse_logic)
+      frame ^= 0x3ff;
+    frame |= 0x400;
+    s->_transmit_buffer_tail = (tail + 1) & (_SS_MAX_TX_BUFF - 1);
+  }
+
+  if (frame & 1)
+    *s->_transmitPortRegister |= s->_transmitBitMask;
+  else
+    *s->_transmitPortRegister &= ~s->_transmitBitMask;
+  tx_frame = frame >> 1;
+
+  // A compare value that is already behind TCNT1 would only match after
+  // the timer wraps, so if this interrupt ran more than a bit time late,
+  // time the next bit from now. That bit comes out long, but the frame
+  // goes on.
+  uint16_t next = OCR1A + s->_tx_bit_ticks;
+  uint16_t ahead = next - TCNT1;
+  if (ahead < SS_TX_MIN_AHEAD || ahead > s->_tx_bit_ticks)
+    next = TCNT1 + SS_TX_MIN_AHEAD;
+  OCR1A = next;
+}
+
+// Runs the TX interrupt handler by hand when it is due but can't fire
+// because interrupts are disabled, so waiting for it can't deadlock
+/* static */
+inline void SoftwareSerial::txPoll()
+{
+  if (bit_is_clear(SREG, SREG_I) && bit_is_set(SS_TIFR, OCF1A))
+  {
+    SS_TIFR = _BV(OCF1A);
+    handle_tx_interrupt();
+  }
+}
+#endif
+
+#if defined(_SS_TIMER1)
+// Let Timer1 count CPU cycles from 0 to 0xffff
+/* static */
+void SoftwareSerial::timerBegin()
+{
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+}
+#endif
+
 //
 // Constructor
 //
 SoftwareSerial::SoftwareSerial(int8_t receivePin, int8_t transmitPin, bool inverse_logic /* = false */) : 
-  _rx_delay_centering(0),
-  _rx_delay_intrabit(0),
-  _rx_delay_stopbit(0),
-  _tx_delay(0),
+  SoftwareSerial(receivePin, transmitPin, inverse_logic, (uint8_t *)malloc(_SS_MAX_RX_BUFF), _SS_MAX_RX_BUFF)
+{
+  _buffer_allocated = true;
+}
+
+SoftwareSerial::SoftwareSerial(int8_t receivePin, int8_t transmitPin, bool inverse_logic, uint8_t *buffer, uint16_t size) : 
+  _rx_delay_centering(),
+  _rx_delay_intrabit(),
+  _rx_delay_stopbit(),
+  _tx_delay(),
   _buffer_overflow(false),
-  _inverse_logic(inverse_logic)
+  _inverse_logic(inverse_logic),
+  _buffer_allocated(false),
+  _half_duplex(receivePin == transmitPin),
+  _receive_buffer(buffer),
+  _receive_buffer_mask(0),
+  _receive_buffer_tail(0),
+  _receive_buffer_head(0)
+#if defined(_SS_TIMER_TX)
+  , _tx_bit_ticks(0),
+  _transmit_buffer_head(0),
+  _transmit_buffer_tail(0)
+#endif
+#if defined(_SS_TIMER_RX)
+  , _listening(false),
+  _rx_bit_ticks(0)
+#endif
 {
+  // Indexes wrap with a mask, so round the size down to a power of two.
+  // Without a buffer the mask stays 0, which makes it look full forever.
+  if (buffer)
+  {
+    uint16_t n = 2;
+    while (n <= size / 2 && n < 256)
+      n <<= 1;
+    if (n <= size)
+      _receive_buffer_mask = n - 1;
+  }
+
   setTX(transmitPin);
   setRX(receivePin);
 }
@@ -274,6 +631,8 @@ SoftwareSerial::SoftwareSerial(int8_t receivePin, int8_t transmitPin, bool inver
 SoftwareSerial::~SoftwareSerial()
 {
   end();
+  if (_buffer_allocated)
+    free(_receive_buffer);
 }
 
 void SoftwareSerial::setTX(int8_t tx)
@@ -282,11 +641,17 @@ void SoftwareSerial::setTX(int8_t tx)
   // the pin would be output low for a short while before switching to
   // output high. Now, it is input with pullup for a short while, which
   // is fine. With inverse logic, either order is fine.
-  digitalWrite(tx, _inverse_logic ? LOW : HIGH);
-  pinMode(tx, OUTPUT);
+  // In half duplex mode setRX() sets the pin up as an input instead, and
+  // busAcquire() makes it an output while sending.
+  if (!_half_duplex)
+  {
+    digitalWrite(tx, _inverse_logic ? LOW : HIGH);
+    pinMode(tx, OUTPUT);
+  }
   _transmitBitMask = digitalPinToBitMask(tx);
   uint8_t port = digitalPinToPort(tx);
   _transmitPortRegister = portOutputRegister(port);
+  _transmitDirRegister = portModeRegister(port);
 }
 
 void SoftwareSerial::setRX(int8_t rx)
@@ -300,70 +665,106 @@ void SoftwareSerial::setRX(int8_t rx)
   _receivePortRegister = portInputRegister(port);
 }
 
-uint16_t SoftwareSerial::subtract_cap(uint16_t num, uint16_t sub) {
-  if (num > sub)
-    return num - sub;
-  else
-    return 1;
+/* static */
+SoftwareSerial::DelayCycles SoftwareSerial::delayFor(long cycles)
+{
+  DelayCycles delay;
+  cycles -= 5;
+  if (cycles < 4)
+    cycles = 4;
+  else if (cycles > 0x3ffffL)
+    cycles = 0x3ffffL;
+  delay.loops = cycles >> 2;
+  delay.extra = cycles & 3;
+  return delay;
+}
+
+// Bit time in cycles, rounded to the nearest cycle
+/* static */
+unsigned long SoftwareSerial::bitCycles(long speed)
+{
+  if (speed <= 0)
+    return 0;
+  return (F_CPU + speed / 2) / speed;
+}
+
+void SoftwareSerial::setRxDelays(unsigned long bit_cycles)
+{
+  long bit = bit_cycles;
+
+  // The bit loop in recv() is assembly, 4 * loops + extra + 15 cycles per
+  // pass. That is 10 cycles more than tunedDelay() with the same delay.
+  _rx_delay_intrabit = delayFor(bit - 10);
+
+  // From the start of the assembly in recv() to the first sample, there
+  // are 4 * loops + extra + 6 cycles of centering delay, 2 for ldi and
+  // clr, and 4 * loops + extra + 6 for the first bit, which comes to the
+  // centering delay plus bit - 1 cycles. We want the first sample 1.5 bit
+  // times after the start bit edge, so the centering delay gets 0.5 bit
+  // time + 1 - (cycles from the edge to the assembly). That is the only
+  // part of the sample timing that depends on the compiler, and an error
+  // there shifts every sample by the same amount instead of adding up.
+  //
+  // When the start bit occurs, there are 3 or 4 cycles before the
+  // interrupt flag is set and 4 cycles before the PC is set to the right
+  // interrupt vector address and the old PC is pushed on the stack.
+#if GCC_VERSION > 40800
+  // This works up to 115200 on 16Mhz and 57600 on 8Mhz. Counted from
+  // gcc 4.8.2 output, there were 75 cycles of instructions (including the
+  // RJMP in the ISR vector table) until the first delay. Loading the extra
+  // operands of the assembly takes about 16 more; that part is estimated.
+  _rx_delay_centering = delayFor(bit / 2 - (4 + 4 + 75 + 16 - 6));
+#else
+  // Counted from gcc 4.3.2 output, which is a _lot_ slower, mostly due to
+  // bad register allocation choices. This works up to 57600 on 16Mhz and
+  // 38400 on 8Mhz.
+  _rx_delay_centering = delayFor(bit / 2 - (4 + 4 + 97 + 16 - 6));
+#endif
+
+  // The assembly ends 6 cycles after the last sample, then undoing
+  // inverse logic and loading the delay take roughly 10 cycles, and there
+  // are 11 cycles from the delay until the interrupt mask is enabled
+  // again (which _must_ happen during the stopbit). This delay aims at
+  // 3/4 of a bit time, meaning the end of the delay will be at 1/4th of
+  // the stopbit. This allows some extra time for ISR cleanup, which makes
+  // 115200 baud at 16Mhz work more reliably.
+  _rx_delay_stopbit = delayFor(bit * 3 / 4 - (6 + 10 + 11));
 }
 
 //
 // Public methods
 //
 
-void SoftwareSerial::begin(long speed)
+void SoftwareSerial::_begin(unsigned long bit_cycles)
 { 
-  _rx_delay_centering = _rx_delay_intrabit = _rx_delay_stopbit = _tx_delay = 0;
-
-  // Precalculate the various delays, in number of 4-cycle delays
-  uint16_t bit_delay = (F_CPU / speed) / 4;
+  _rx_delay_centering.loops = _rx_delay_intrabit.loops = _rx_delay_stopbit.loops = _tx_delay.loops = 0;
+  if (!bit_cycles)
+    return;
 
   // 12 (gcc 4.8.2) or 13 (gcc 4.3.2) cycles from start bit to first bit,
   // 15 (gcc 4.8.2) or 16 (gcc 4.3.2) cycles between bits,
   // 12 (gcc 4.8.2) or 14 (gcc 4.3.2) cycles from last bit to stop bit
   // These are all close enough to just use 15 cycles, since the inter-bit
   // timings are the most critical (deviations stack 8 times)
-  _tx_delay = subtract_cap(bit_delay, 15 / 4);
+  _tx_delay = delayFor((long)bit_cycles - 15);
+
+#if defined(_SS_TIMER_TX)
+  _tx_bit_ticks = bit_cycles > 0xffff ? 0 : bit_cycles;
+  if (_tx_bit_ticks)
+    timerBegin();
+#endif
+#if defined(_SS_TIMER_RX)
+  // Everything up to the end of the last data bit must fit in the counter
+  stopListening();
+  _rx_bit_ticks = bit_cycles * 19 / 2 > 0xffff ? 0 : bit_cycles;
+  if (_rx_bit_ticks)
+    timerBegin();
+#endif
 
 #if defined(PCINT_ONLY) || defined(INT_AND_PCINT)
   // Only setup rx when we have a valid PCINT for this pin
   if (digitalPinToPCICR(_receivePin)) {
-    #if GCC_VERSION > 40800
-    // Timings counted from gcc 4.8.2 output. This works up to 115200 on
-    // 16Mhz and 57600 on 8Mhz.
-    //
-    // When the start bit occurs, there are 3 or 4 cycles before the
-    // interrupt flag is set, 4 cycles before the PC is set to the right
-    // interrupt vector address and the old PC is pushed on the stack,
-    // and then 75 cycles of instructions (including the RJMP in the
-    // ISR vector table) until the first delay. After the delay, there
-    // are 17 more cycles until the pin value is read (excluding the
-    // delay in the loop).
-    // We want to have a total delay of 1.5 bit time. Inside the loop,
-    // we already wait for 1 bit time - 23 cycles, so here we wait for
-    // 0.5 bit time - (71 + 18 - 22) cycles.
-    _rx_delay_centering = subtract_cap(bit_delay / 2, (4 + 4 + 75 + 17 - 23) / 4);
-
-    // There are 23 cycles in each loop iteration (excluding the delay)
-    _rx_delay_intrabit = subtract_cap(bit_delay, 23 / 4);
-
-    // There are 37 cycles from the last bit read to the start of
-    // stopbit delay and 11 cycles from the delay until the interrupt
-    // mask is enabled again (which _must_ happen during the stopbit).
-    // This delay aims at 3/4 of a bit time, meaning the end of the
-    // delay will be at 1/4th of the stopbit. This allows some extra
-    // time for ISR cleanup, which makes 115200 baud at 16Mhz work more
-    // reliably
-    _rx_delay_stopbit = subtract_cap(bit_delay * 3 / 4, (37 + 11) / 4);
-    #else // Timings counted from gcc 4.3.2 output
-    // Note that this code is a _lot_ slower, mostly due to bad register
-    // allocation choices of gcc. This works up to 57600 on 16Mhz and
-    // 38400 on 8Mhz.
-    _rx_delay_centering = subtract_cap(bit_delay / 2, (4 + 4 + 97 + 29 - 11) / 4);
-    _rx_delay_intrabit = subtract_cap(bit_delay, 11 / 4);
-    _rx_delay_stopbit = subtract_cap(bit_delay * 3 / 4, (44 + 17) / 4);
-    #endif
-
+    setRxDelays(bit_cycles);
 
     // Enable the PCINT for the entire port here, but never disable it
     // (others might also need it, so we disable the interrupt by using
@@ -383,44 +784,18 @@ void SoftwareSerial::begin(long speed)
 #endif  
 #if defined(INT_ONLY) || defined(INT_AND_PCINT)
   {
-     // Direct interrupts
-     attachInterrupt(digitalPinToInterrupt(_receivePin), isr, CHANGE);
-     
-    #if GCC_VERSION > 40800
-    // Timings counted from gcc 4.8.2 output. This works up to 115200 on
-    // 16Mhz and 57600 on 8Mhz.
-    //
-    // When the start bit occurs, there are 3 or 4 cycles before the
-    // interrupt flag is set, 4 cycles before the PC is set to the right
-    // interrupt vector address and the old PC is pushed on the stack,
-    // and then 75 cycles of instructions (including the RJMP in the
-    // ISR vector table) until the first delay. After the delay, there
-    // are 17 more cycles until the pin value is read (excluding the
-    // delay in the loop).
-    // We want to have a total delay of 1.5 bit time. Inside the loop,
-    // we already wait for 1 bit time - 23 cycles, so here we wait for
-    // 0.5 bit time - (71 + 18 - 22) cycles.
-    _rx_delay_centering = subtract_cap(bit_delay / 2, (4 + 4 + 75 + 17 - 23) / 4);
-
-    // There are 23 cycles in each loop iteration (excluding the delay)
-    _rx_delay_intrabit = subtract_cap(bit_delay, 23 / 4);
-
-    // There are 37 cycles from the last bit read to the start of
-    // stopbit delay and 11 cycles from the delay until the interrupt
-    // mask is enabled again (which _must_ happen during the stopbit).
-    // This delay aims at 3/4 of a bit time, meaning the end of the
-    // delay will be at 1/4th of the stopbit. This allows some extra
-    // time for ISR cleanup, which makes 115200 baud at 16Mhz work more
-    // reliably
-    _rx_delay_stopbit = subtract_cap(bit_delay * 3 / 4, (37 + 11) / 4);
-    #else // Timings counted from gcc 4.3.2 output
-    // Note that this code is a _lot_ slower, mostly due to bad register
-    // allocation choices of gcc. This works up to 57600 on 16Mhz and
-    // 38400 on 8Mhz.
-    _rx_delay_centering = subtract_cap(bit_delay / 2, (4 + 4 + 97 + 29 - 11) / 4);
-    _rx_delay_intrabit = subtract_cap(bit_delay, 11 / 4);
-    _rx_delay_stopbit = subtract_cap(bit_delay * 3 / 4, (44 + 17) / 4);
-    #endif
+    // Direct interrupts. attachInterrupt() sets the enable bit of the pin's
+    // INTn in the mask register, so setRxIntMsk() can turn it on and off
+    // the same way it does a PCMSK bit. detachInterrupt() first, so the
+    // bit shows up even if begin() was called before.
+    uint8_t irq = digitalPinToInterrupt(_receivePin);
+    detachInterrupt(irq);
+    uint8_t before = SS_EIMSK;
+    attachInterrupt(irq, isr, CHANGE);
+    _pcint_maskreg = &SS_EIMSK;
+    _pcint_maskvalue = SS_EIMSK & ~before;
+
+    setRxDelays(bit_cycles);
 
     tunedDelay(_tx_delay); // if we were low this establishes the end
   }
@@ -442,8 +817,35 @@ void SoftwareSerial::setRxIntMsk(bool enable)
       *_pcint_maskreg &= ~_pcint_maskvalue;
 }
 
+// True while a half duplex port is driving its pin
+bool SoftwareSerial::txDriving()
+{
+  return _half_duplex && (*_transmitDirRegister & _transmitBitMask);
+}
+
+// Takes a half duplex bus before sending. The pin change interrupt goes
+// off first so our own bytes are never received, then the pin becomes an
+// output. PORT already holds the idle level (the pullup for normal logic),
+// so the line doesn't glitch. Must be called with interrupts disabled.
+void SoftwareSerial::busAcquire()
+{
+  setRxIntMsk(false);
+  *_transmitDirRegister |= _transmitBitMask;
+}
+
+// Hands a half duplex bus back once the stop bit is complete, and only
+// then re-arms the pin change interrupt. Must be called with interrupts
+// disabled.
+void SoftwareSerial::busRelease()
+{
+  *_transmitDirRegister &= ~_transmitBitMask;
+  if (isListening())
+    setRxIntMsk(true);
+}
+
 void SoftwareSerial::end()
 {
+  flush();
   stopListening();
 }
 
@@ -451,30 +853,68 @@ void SoftwareSerial::end()
 // Read data from buffer
 int SoftwareSerial::read()
 {
-  if (!isListening())
-    return -1;
-
   // Empty buffer?
   if (_receive_buffer_head == _receive_buffer_tail)
     return -1;
 
   // Read from "head"
   uint8_t d = _receive_buffer[_receive_buffer_head]; // grab next byte
-  _receive_buffer_head = (_receive_buffer_head + 1) % _SS_MAX_RX_BUFF;
+  _receive_buffer_head = (_receive_buffer_head + 1) & _receive_buffer_mask;
   return d;
 }
 
 int SoftwareSerial::available()
 {
-  if (!isListening())
+  return (uint8_t)(_receive_buffer_tail - _receive_buffer_head) & _receive_buffer_mask;
+}
+
+#if defined(_SS_TIMER_TX)
+size_t SoftwareSerial::write(uint8_t b)
+{
+  if (_tx_bit_ticks == 0) {
+    setWriteError();
     return 0;
+  }
+
+  // Wait for room in the buffer, and for other ports to finish sending
+  uint8_t head = _transmit_buffer_head;
+  uint8_t next = (head + 1) & (_SS_MAX_TX_BUFF - 1);
+  while (next == _transmit_buffer_tail || (tx_active_object && tx_active_object != this))
+    txPoll();
+
+  _transmit_buffer[head] = b;
+  _transmit_buffer_head = next;
 
-  return (_receive_buffer_tail + _SS_MAX_RX_BUFF - _receive_buffer_head) % _SS_MAX_RX_BUFF;
+  // Start the TX interrupt if it isn't running already. If it just
+  // finished, it did so before the byte was queued, so check again with
+  // interrupts disabled.
+  uint8_t oldSREG = SREG;
+  cli();
+  if (!tx_active_object)
+  {
+    if (_half_duplex)
+      busAcquire();
+    tx_active_object = this;
+    tx_frame = 0;
+    OCR1A = TCNT1 + 64;
+    SS_TIFR = _BV(OCF1A);
+    SS_TIMSK |= _BV(OCIE1A);
+  }
+  SREG = oldSREG;
+
+  return 1;
 }
 
+void SoftwareSerial::flush()
+{
+  // Wait until the stop bit of the last byte has been sent
+  while (tx_active_object == this)
+    txPoll();
+}
+#else
 size_t SoftwareSerial::write(uint8_t b)
 {
-  if (_tx_delay == 0) {
+  if (_tx_delay.loops == 0) {
     setWriteError();
     return 0;
   }
@@ -488,13 +928,16 @@ size_t SoftwareSerial::write(uint8_t b)
   uint8_t inv_mask = ~_transmitBitMask;
   uint8_t oldSREG = SREG;
   bool inv = _inverse_logic;
-  uint16_t delay = _tx_delay;
+  DelayCycles delay = _tx_delay;
 
   if (inv)
     b = ~b;
 
   cli();  // turn off interrupts for a clean txmit
 
+  if (_half_duplex)
+    busAcquire();
+
   // Write the start bit
   if (inv)
     *reg |= reg_mask;
@@ -523,6 +966,13 @@ size_t SoftwareSerial::write(uint8_t b)
 
   SREG = oldSREG; // turn interrupts back on
   tunedDelay(_tx_delay);
+
+  if (_half_duplex)
+  {
+    cli();
+    busRelease();
+    SREG = oldSREG;
+  }
   
   return 1;
 }
@@ -531,12 +981,10 @@ void SoftwareSerial::flush()
 {
   // There is no tx buffering, simply return
 }
+#endif
 
 int SoftwareSerial::peek()
 {
-  if (!isListening())
-    return -1;
-
   // Empty buffer?
   if (_receive_buffer_head == _receive_buffer_tail)
     return -1;
@@ -57,7 +57,34 @@ http://arduiniana.org.
 ******************************************************************************/
 
 #ifndef _SS_MAX_RX_BUFF
-#define _SS_MAX_RX_BUFF 64 // RX buffer size
+#define _SS_MAX_RX_BUFF 64 // Default RX buffer size, must be a power of two
+#endif
+
+// Define _SS_TIMER_TX to send from a Timer1 compare interrupt instead of
+// bit-banging each byte with interrupts disabled. write() then only queues
+// the byte. Timer1 is switched to a free running counter at F_CPU, so PWM
+// on its pins, the Servo library and (on ATmega162/8515) tone() can't be
+// used, and the lowest baud rate is F_CPU / 65535.
+#if defined(_SS_TIMER_TX)
+#ifndef _SS_MAX_TX_BUFF
+#define _SS_MAX_TX_BUFF 32 // TX buffer size, must be a power of two
+#endif
+#endif
+
+// Define _SS_TIMER_RX to decode received bytes from pin change timestamps
+// taken from the same Timer1 counter, instead of sampling the whole byte
+// inside the pin change interrupt. The interrupt then only takes a few
+// microseconds per edge, and up to _SS_MAX_LISTENERS ports can listen at
+// the same time. A frame has to fit in the
+// 16-bit counter, so the lowest baud rate is about F_CPU / 6800.
+#if defined(_SS_TIMER_RX)
+#ifndef _SS_MAX_LISTENERS
+#define _SS_MAX_LISTENERS 4
+#endif
+#endif
+
+#if defined(_SS_TIMER_TX) || defined(_SS_TIMER_RX)
+#define _SS_TIMER1
 #endif
 
 #ifndef GCC_VERSION
@@ -66,6 +93,15 @@ http://arduiniana.org.
 
 class SoftwareSerial : public Stream
 {
+public:
+  // A delay of 4 * loops + extra cycles on top of the fixed overhead of
+  // tunedDelay(). loops must never be 0!
+  struct DelayCycles
+  {
+    uint16_t loops;
+    uint8_t extra;
+  };
+
 private:
   // per object data
   int8_t _receivePin;
@@ -73,45 +109,123 @@ private:
   volatile uint8_t *_receivePortRegister;
   uint8_t _transmitBitMask;
   volatile uint8_t *_transmitPortRegister;
+  volatile uint8_t *_transmitDirRegister;
   volatile uint8_t *_pcint_maskreg;
   uint8_t _pcint_maskvalue;
 
-  // Expressed as 4-cycle delays (must never be 0!)
-  uint16_t _rx_delay_centering;
-  uint16_t _rx_delay_intrabit;
-  uint16_t _rx_delay_stopbit;
-  uint16_t _tx_delay;
+  DelayCycles _rx_delay_centering;
+  DelayCycles _rx_delay_intrabit;
+  DelayCycles _rx_delay_stopbit;
+  DelayCycles _tx_delay;
 
   uint16_t _buffer_overflow:1;
   uint16_t _inverse_logic:1;
+  uint16_t _buffer_allocated:1;
+  uint16_t _half_duplex:1;
+
+  // Every port has its own RX buffer, so data isn't lost when switching
+  // between ports with listen()
+  uint8_t *_receive_buffer;
+  uint8_t _receive_buffer_mask;
+  volatile uint8_t _receive_buffer_tail;
+  volatile uint8_t _receive_buffer_head;
+
+#if defined(_SS_TIMER_TX)
+  // Bit time in Timer1 ticks (CPU cycles)
+  uint16_t _tx_bit_ticks;
+  uint8_t _transmit_buffer[_SS_MAX_TX_BUFF];
+  volatile uint8_t _transmit_buffer_head;
+  volatile uint8_t _transmit_buffer_tail;
+#endif
 
+#if defined(_SS_TIMER_RX)
+  uint16_t _listening:1;
+  // Bit time in Timer1 ticks, and the frame being decoded. _rx_bit is the
+  // next data bit (1-8), or 0 while waiting for a start bit.
+  uint16_t _rx_bit_ticks;
+  uint16_t _rx_start;
+  uint16_t _rx_sample;
+  uint8_t _rx_bit;
+  uint8_t _rx_data;
+  uint8_t _rx_level;
+
+  // static data
+  static SoftwareSerial *listeners[_SS_MAX_LISTENERS];
+#else
   // static data
-  static uint8_t _receive_buffer[_SS_MAX_RX_BUFF]; 
-  static volatile uint8_t _receive_buffer_tail;
-  static volatile uint8_t _receive_buffer_head;
   static SoftwareSerial *active_object;
+#endif
+#if defined(_SS_TIMER_TX)
+  // The port the TX interrupt is sending for, and what is left of the
+  // frame it is sending
+  static SoftwareSerial * volatile tx_active_object;
+  static uint16_t tx_frame;
+#endif
 
   // private methods
   inline void recv() __attribute__((__always_inline__));
+  inline void rxStore(uint8_t d) __attribute__((__always_inline__));
+#if defined(_SS_TIMER_RX)
+  void rxEdge(uint16_t now);
+  void rxFill(uint16_t now, uint8_t level);
+#endif
   uint8_t rx_pin_read();
   void setTX(int8_t transmitPin);
   void setRX(int8_t receivePin);
   inline void setRxIntMsk(bool enable) __attribute__((__always_inline__));
+  inline bool txDriving() __attribute__((__always_inline__));
+  inline void busAcquire() __attribute__((__always_inline__));
+  inline void busRelease() __attribute__((__always_inline__));
 
-  // Return num - sub, or 1 if the result would be < 1
-  static uint16_t subtract_cap(uint16_t num, uint16_t sub);
+  // The delay that makes tunedDelay() take the given number of cycles, or
+  // as close as it gets for very short delays
+  static DelayCycles delayFor(long cycles);
+  void setRxDelays(unsigned long bit_cycles);
+  void _begin(unsigned long bit_cycles);
+  static unsigned long bitCycles(long speed);
 
   // private static method for timing
-  static inline void tunedDelay(uint16_t delay);
+  static inline void tunedDelay(DelayCycles delay) __attribute__((__always_inline__));
+
+#if defined(_SS_TIMER1)
+  static void timerBegin();
+#endif
+#if defined(_SS_TIMER_TX)
+  static inline void txPoll();
+#endif
 
 public:
   // public methods
+  // Allocates an RX buffer of _SS_MAX_RX_BUFF bytes from the heap. If that
+  // fails, nothing is received and the port tests false. SoftwareSerialT
+  // keeps the buffer in the object instead. Passing the same pin as
+  // receivePin and transmitPin selects half duplex mode for single wire
+  // buses: the pin is only driven while sending, and the port doesn't
+  // receive its own bytes.
   SoftwareSerial(int8_t receivePin, int8_t transmitPin, bool inverse_logic = false);
+  // Uses the given RX buffer instead. Only the largest power of two that
+  // fits in size (up to 256) is used.
+  SoftwareSerial(int8_t receivePin, int8_t transmitPin, bool inverse_logic, uint8_t *buffer, uint16_t size);
   ~SoftwareSerial();
-  void begin(long speed);
+  // A copy would share the RX buffer, and free it twice
+  SoftwareSerial(const SoftwareSerial &) = delete;
+  SoftwareSerial &operator=(const SoftwareSerial &) = delete;
+  inline void begin(long speed) __attribute__((__always_inline__))
+  {
+    // Constant baud rates get their bit time calculated at compile time,
+    // others call a helper instead of inlining the division here
+    if (__builtin_constant_p(speed))
+      _begin(speed > 0 ? (F_CPU + speed / 2) / speed : 0);
+    else
+      _begin(bitCycles(speed));
+  }
   bool listen();
   void end();
+#if defined(_SS_TIMER_RX)
+  bool isListening() { return _listening; }
+#else
   bool isListening() { return this == active_object; }
+#endif
   bool stopListening();
   bool overflow() { bool ret = _buffer_overflow; if (ret) _buffer_overflow = false; return ret; }
   int peek();
@@ -120,12 +234,33 @@ public:
   virtual int read();
   virtual int available();
   virtual void flush();
-  operator bool() { return true; }
+  operator bool() { return _receive_buffer || !_buffer_allocated; }
   
   using Print::write;
 
   // public only for easy access by interrupt handlers
   static inline void handle_interrupt() __attribute__((__always_inline__));
+#if defined(_SS_TIMER_RX)
+  static inline void handle_rx_timeout() __attribute__((__always_inline__));
+#endif
+#if defined(_SS_TIMER_TX)
+  static inline void handle_tx_interrupt() __attribute__((__always_inline__));
+#endif
+};
+
+// A SoftwareSerial with a built in RX buffer of RX_BUFFER_SIZE bytes
+template<uint16_t RX_BUFFER_SIZE>
+class SoftwareSerialT : public SoftwareSerial
+{
+  static_assert(RX_BUFFER_SIZE >= 2 && RX_BUFFER_SIZE <= 256 && (RX_BUFFER_SIZE & (RX_BUFFER_SIZE - 1)) == 0,
+    "RX_BUFFER_SIZE must be a power of two from 2 to 256");
+
+private:
+  uint8_t _buffer[RX_BUFFER_SIZE];
+
+public:
+  SoftwareSerialT(int8_t receivePin, int8_t transmitPin, bool inverse_logic = false) :
+    SoftwareSerial(receivePin, transmitPin, inverse_logic, _buffer, RX_BUFFER_SIZE) {}
 };
 
 // Arduino 0012 workaround
@@ -0,0 +1,60 @@
+/*
+  Display Fill
+
+  This example fills the screen of an ST7735, ST7789 or ILI9341 based
+  display with one colour after another, using USART0 as an SPI bus.
+  The display is expected to be initialized and have its drawing window
+  set to the whole screen already, this only sends the memory write
+  command and the pixels.
+
+  Since the USART transmitter is double buffered, the pixels go out back
+  to back at fosc/2 with no gap between the bytes.
+
+  The circuit:
+  * SDA/MOSI - to digital pin 1 (TXD)
+  * SCL/SCK  - to digital pin 4 (XCK)
+  * CS       - to digital pin 10
+  * DC       - to digital pin 9
+
+  Serial can't be used while USART0 is an SPI bus.
+*/
+
+#include <USARTSPI.h>
+
+const uint8_t csPin = 10;
+const uint8_t dcPin = 9;
+const uint16_t pixels = 240UL * 320UL / 16; // Sent 16 pixels at a time
+
+uint8_t line[32];
+
+void setup() {
+  pinMode(csPin, OUTPUT);
+  digitalWrite(csPin, HIGH);
+  pinMode(dcPin, OUTPUT);
+  USARTSPI.begin();
+}
+
+void fill(uint16_t colour) {
+  for (uint8_t i = 0; i < sizeof(line); i += 2) {
+    line[i] = colour >> 8;
+    line[i + 1] = colour;
+  }
+
+  USARTSPI.beginTransaction(USARTSPISettings(F_CPU / 2, MSBFIRST, SPI_MODE0));
+  digitalWrite(csPin, LOW);
+  digitalWrite(dcPin, LOW);
+  USARTSPI.transfer(0x2C); // Memory write
+  digitalWrite(dcPin, HIGH);
+  for (uint16_t i = 0; i < pixels; i++) {
+    // No receive buffer, so the pixels are only sent
+    USARTSPI.transfer(line, NULL, sizeof(line));
+  }
+  digitalWrite(csPin, HIGH);
+  USARTSPI.endTransaction();
+}
+
+void loop() {
+  fill(0xF800); // Red
+  fill(0x07E0); // Green
+  fill(0x001F); // Blue
+}
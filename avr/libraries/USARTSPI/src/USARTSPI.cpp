@@ -0,0 +1,232 @@
+/*
+ * USARTSPI.cpp - SPI master on a USART in Master SPI mode (MSPIM)
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either the GNU General Public License version 2
+ * or the GNU Lesser General Public License version 2.1, both as
+ * published by the Free Software Foundation.
+ */
+
+#include "USARTSPI.h"
+
+#if defined(HAVE_USARTSPI0) || defined(HAVE_USARTSPI1)
+
+USARTSPIClass::USARTSPIClass(volatile uint8_t *ubrrh, volatile uint8_t *ubrrl,
+  volatile uint8_t *ucsra, volatile uint8_t *ucsrb,
+  volatile uint8_t *ucsrc, volatile uint8_t *udr,
+  volatile uint8_t *xckddr, uint8_t xckmask) :
+    _ubrrh(ubrrh), _ubrrl(ubrrl),
+    _ucsra(ucsra), _ucsrb(ucsrb), _ucsrc(ucsrc),
+    _udr(udr),
+    _xckddr(xckddr), _xckmask(xckmask),
+    initialized(0),
+    interruptMode(0),
+    interruptMask(0),
+    interruptSave(0)
+{
+}
+
+void USARTSPIClass::begin()
+{
+  uint8_t sreg = SREG;
+  noInterrupts(); // Protect from a scheduler and prevent transactionBegin
+  if (!initialized) {
+    // UBRR has to be zero when the transmitter is enabled, or XCK doesn't
+    // start up right away
+    setUBRR(0);
+    *_xckddr |= _xckmask;
+    *_ucsrc = USARTSPI_UMSEL;
+    // The transmitter and receiver take over the TXD and RXD pins
+    *_ucsrb = _BV(RXEN0) | _BV(TXEN0);
+    USARTSPISettings settings;
+    setUBRR(settings.ubrr);
+  }
+  initialized++; // reference count
+  SREG = sreg;
+}
+
+void USARTSPIClass::end() {
+  uint8_t sreg = SREG;
+  noInterrupts(); // Protect from a scheduler and prevent transactionBegin
+  // Decrease the reference counter
+  if (initialized)
+    initialized--;
+  // If there are no more references disable the USART
+  if (!initialized) {
+    *_ucsrb = 0;
+    interruptMode = 0;
+  }
+  SREG = sreg;
+}
+
+void USARTSPIClass::transfer(const void *txbuf, void *rxbuf, size_t count)
+{
+  if (count == 0) return;
+  const uint8_t *tx = (const uint8_t *)txbuf;
+  uint8_t *rx = (uint8_t *)rxbuf;
+  volatile uint8_t *ucsra = _ucsra;
+  volatile uint8_t *udr = _udr;
+
+  if (!rx) {
+    // Refill the transmit buffer as soon as it is empty. TXC is cleared by
+    // writing a one to it, and tells when the last byte is out.
+    *ucsra = _BV(TXC0);
+    if (tx) {
+      do {
+        while (!(*ucsra & _BV(UDRE0))) ;
+        *udr = *tx++;
+      } while (--count);
+    } else {
+      do {
+        while (!(*ucsra & _BV(UDRE0))) ;
+        *udr = 0xff;
+      } while (--count);
+    }
+    while (!(*ucsra & _BV(TXC0))) ;
+    while (*ucsra & _BV(RXC0))
+      (void)*udr;
+    return;
+  }
+
+  // Keep the next byte waiting in the transmit buffer while the current
+  // one is shifted, so reading a byte back never holds up the clock. The
+  // receive buffer has room for two bytes, so nothing is lost either.
+  *udr = tx ? *tx++ : 0xff;
+  while (--count > 0) {
+    while (!(*ucsra & _BV(UDRE0))) ;
+    *udr = tx ? *tx++ : 0xff;
+    while (!(*ucsra & _BV(RXC0))) ;
+    *rx++ = *udr;
+  }
+  while (!(*ucsra & _BV(RXC0))) ;
+  *rx = *udr;
+}
+
+void USARTSPIClass::setClockDivider(uint8_t clockDiv)
+{
+  // UBRR for each SPI_CLOCK_DIVn, the last one is SPI's second fosc/64
+  static const uint8_t ubrr[] PROGMEM = { 1, 7, 31, 63, 0, 3, 15, 31 };
+  setUBRR(pgm_read_byte(&ubrr[clockDiv & 0x07]));
+}
+
+// mapping of interrupt numbers to bits within SPI_AVR_EIMSK
+#if defined(__AVR_ATmega32U4__)
+  #define SPI_INT0_MASK  (1<<INT0)
+  #define SPI_INT1_MASK  (1<<INT1)
+  #define SPI_INT2_MASK  (1<<INT2)
+  #define SPI_INT3_MASK  (1<<INT3)
+  #define SPI_INT4_MASK  (1<<INT6)
+#elif defined(__AVR_AT90USB646__) || defined(__AVR_AT90USB1286__)
+  #define SPI_INT0_MASK  (1<<INT0)
+  #define SPI_INT1_MASK  (1<<INT1)
+  #define SPI_INT2_MASK  (1<<INT2)
+  #define SPI_INT3_MASK  (1<<INT3)
+  #define SPI_INT4_MASK  (1<<INT4)
+  #define SPI_INT5_MASK  (1<<INT5)
+  #define SPI_INT6_MASK  (1<<INT6)
+  #define SPI_INT7_MASK  (1<<INT7)
+#elif defined(EICRA) && defined(EICRB) && defined(EIMSK)
+  #define SPI_INT0_MASK  (1<<INT4)
+  #define SPI_INT1_MASK  (1<<INT5)
+  #define SPI_INT2_MASK  (1<<INT0)
+  #define SPI_INT3_MASK  (1<<INT1)
+  #define SPI_INT4_MASK  (1<<INT2)
+  #define SPI_INT5_MASK  (1<<INT3)
+  #define SPI_INT6_MASK  (1<<INT6)
+  #define SPI_INT7_MASK  (1<<INT7)
+#else
+  #ifdef INT0
+  #define SPI_INT0_MASK  (1<<INT0)
+  #endif
+  #ifdef INT1
+  #define SPI_INT1_MASK  (1<<INT1)
+  #endif
+  #ifdef INT2
+  #define SPI_INT2_MASK  (1<<INT2)
+  #endif
+#endif
+
+void USARTSPIClass::usingInterrupt(uint8_t interruptNumber)
+{
+  uint8_t mask = 0;
+  uint8_t sreg = SREG;
+  noInterrupts(); // Protect from a scheduler and prevent transactionBegin
+  switch (interruptNumber) {
+  #ifdef SPI_INT0_MASK
+  case 0: mask = SPI_INT0_MASK; break;
+  #endif
+  #ifdef SPI_INT1_MASK
+  case 1: mask = SPI_INT1_MASK; break;
+  #endif
+  #ifdef SPI_INT2_MASK
+  case 2: mask = SPI_INT2_MASK; break;
+  #endif
+  #ifdef SPI_INT3_MASK
+  case 3: mask = SPI_INT3_MASK; break;
+  #endif
+  #ifdef SPI_INT4_MASK
+  case 4: mask = SPI_INT4_MASK; break;
+  #endif
+  #ifdef SPI_INT5_MASK
+  case 5: mask = SPI_INT5_MASK; break;
+  #endif
+  #ifdef SPI_INT6_MASK
+  case 6: mask = SPI_INT6_MASK; break;
+  #endif
+  #ifdef SPI_INT7_MASK
+  case 7: mask = SPI_INT7_MASK; break;
+  #endif
+  default:
+    interruptMode = 2;
+    break;
+  }
+  interruptMask |= mask;
+  if (!interruptMode)
+    interruptMode = 1;
+  SREG = sreg;
+}
+
+void USARTSPIClass::notUsingInterrupt(uint8_t interruptNumber)
+{
+  // Once in mode 2 we can't go back to 0 without a proper reference count
+  if (interruptMode == 2)
+    return;
+  uint8_t mask = 0;
+  uint8_t sreg = SREG;
+  noInterrupts(); // Protect from a scheduler and prevent transactionBegin
+  switch (interruptNumber) {
+  #ifdef SPI_INT0_MASK
+  case 0: mask = SPI_INT0_MASK; break;
+  #endif
+  #ifdef SPI_INT1_MASK
+  case 1: mask = SPI_INT1_MASK; break;
+  #endif
+  #ifdef SPI_INT2_MASK
+  case 2: mask = SPI_INT2_MASK; break;
+  #endif
+  #ifdef SPI_INT3_MASK
+  case 3: mask = SPI_INT3_MASK; break;
+  #endif
+  #ifdef SPI_INT4_MASK
+  case 4: mask = SPI_INT4_MASK; break;
+  #endif
+  #ifdef SPI_INT5_MASK
+  case 5: mask = SPI_INT5_MASK; break;
+  #endif
+  #ifdef SPI_INT6_MASK
+  case 6: mask = SPI_INT6_MASK; break;
+  #endif
+  #ifdef SPI_INT7_MASK
+  case 7: mask = SPI_INT7_MASK; break;
+  #endif
+  default:
+    break;
+    // this case can't be reached
+  }
+  interruptMask &= ~mask;
+  if (!interruptMask)
+    interruptMode = 0;
+  SREG = sreg;
+}
+
+#endif
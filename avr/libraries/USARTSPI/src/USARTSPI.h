@@ -0,0 +1,268 @@
+/*
+ * USARTSPI.h - SPI master on a USART in Master SPI mode (MSPIM)
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either the GNU General Public License version 2
+ * or the GNU Lesser General Public License version 2.1, both as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef _USARTSPI_H_INCLUDED
+#define _USARTSPI_H_INCLUDED
+
+#include <Arduino.h>
+
+// USARTSPI works like SPI, with MOSI on the TXD pin, MISO on the RXD pin
+// and SCK on the XCK pin of the USART. The transmitter is double buffered,
+// so the next byte can be written while the current one is shifted out,
+// and a buffer goes out without the gap SPI leaves between bytes. The
+// USART can't be used as a serial port at the same time, so USARTSPI
+// can't be used together with Serial, and USARTSPI1 not with Serial1.
+// On the ATmega328PB, USART1 shares its pins with SPI.
+
+#ifndef LSBFIRST
+#define LSBFIRST 0
+#endif
+#ifndef MSBFIRST
+#define MSBFIRST 1
+#endif
+
+#define SPI_CLOCK_DIV4 0x00
+#define SPI_CLOCK_DIV16 0x01
+#define SPI_CLOCK_DIV64 0x02
+#define SPI_CLOCK_DIV128 0x03
+#define SPI_CLOCK_DIV2 0x04
+#define SPI_CLOCK_DIV8 0x05
+#define SPI_CLOCK_DIV32 0x06
+
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x04
+#define SPI_MODE2 0x08
+#define SPI_MODE3 0x0C
+
+// UCSRnC bits in Master SPI mode. They have the same positions on every
+// USART, but not every chip header has names for them.
+#define USARTSPI_UMSEL 0xC0  // UMSELn1 and UMSELn0, Master SPI mode
+#define USARTSPI_UDORD 0x04  // LSB first
+#define USARTSPI_UCPHA 0x02
+#define USARTSPI_UCPOL 0x01
+
+// define SPI_AVR_EIMSK for AVR boards with external interrupt pins
+#if defined(EIMSK)
+  #define SPI_AVR_EIMSK  EIMSK
+#elif defined(GICR)
+  #define SPI_AVR_EIMSK  GICR
+#elif defined(GIMSK)
+  #define SPI_AVR_EIMSK  GIMSK
+#endif
+
+// Data direction register and mask of each XCK pin, which has to be an
+// output for the USART to be the master
+#if defined(__AVR_ATmega640__) || defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__) \
+|| defined(__AVR_ATmega1281__) || defined(__AVR_ATmega2561__)
+  #define USARTSPI0_XCK_PIN &DDRE, _BV(2)
+  #define USARTSPI1_XCK_PIN &DDRD, _BV(5)
+#elif defined(__AVR_ATmega164A__) || defined(__AVR_ATmega164P__) || defined(__AVR_ATmega324A__) \
+|| defined(__AVR_ATmega324P__) || defined(__AVR_ATmega324PA__) || defined(__AVR_ATmega324PB__) \
+|| defined(__AVR_ATmega644__) || defined(__AVR_ATmega644P__) || defined(__AVR_ATmega1284__) \
+|| defined(__AVR_ATmega1284P__)
+  #define USARTSPI0_XCK_PIN &DDRB, _BV(0)
+  #define USARTSPI1_XCK_PIN &DDRD, _BV(4)
+#elif defined(__AVR_ATmega328PB__)
+  #define USARTSPI0_XCK_PIN &DDRD, _BV(4)
+  #define USARTSPI1_XCK_PIN &DDRB, _BV(5)
+#else
+  #define USARTSPI0_XCK_PIN &DDRD, _BV(4)
+#endif
+
+// Only USARTs with Master SPI mode get an instance. The ATmega8 and
+// ATmega8515 style USARTs don't have it.
+#if defined(UMSEL01) && defined(UDR0)
+  #define HAVE_USARTSPI0
+#endif
+#if defined(UMSEL11) && defined(UDR1) && defined(USARTSPI1_XCK_PIN)
+  #define HAVE_USARTSPI1
+#endif
+
+class USARTSPISettings {
+public:
+  USARTSPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) {
+    if (__builtin_constant_p(clock)) {
+      init_AlwaysInline(clock, bitOrder, dataMode);
+    } else {
+      init_MightInline(clock, bitOrder, dataMode);
+    }
+  }
+  USARTSPISettings() {
+    init_AlwaysInline(4000000, MSBFIRST, SPI_MODE0);
+  }
+private:
+  void init_MightInline(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) {
+    init_AlwaysInline(clock, bitOrder, dataMode);
+  }
+  void init_AlwaysInline(uint32_t clock, uint8_t bitOrder, uint8_t dataMode)
+    __attribute__((__always_inline__)) {
+    // The clock is fosc/(2 * (UBRR + 1)), so every even divider from 2 to
+    // 8192 is available. We find the fastest clock that is less than or
+    // equal to the given clock rate, or the slowest one if nothing is
+    // slow enough.
+    uint32_t div = clock ? (F_CPU / 2 + clock - 1) / clock : 4096;
+    if (div > 4096)
+      div = 4096;
+    ubrr = div - 1;
+
+    // SPI_MODEn has CPOL in bit 3 and CPHA in bit 2
+    ucsrc = USARTSPI_UMSEL | ((bitOrder == LSBFIRST) ? USARTSPI_UDORD : 0) |
+      ((dataMode >> 1) & USARTSPI_UCPHA) | ((dataMode >> 3) & USARTSPI_UCPOL);
+  }
+  uint16_t ubrr;
+  uint8_t ucsrc;
+  friend class USARTSPIClass;
+};
+
+
+class USARTSPIClass {
+public:
+  USARTSPIClass(volatile uint8_t *ubrrh, volatile uint8_t *ubrrl,
+    volatile uint8_t *ucsra, volatile uint8_t *ucsrb,
+    volatile uint8_t *ucsrc, volatile uint8_t *udr,
+    volatile uint8_t *xckddr, uint8_t xckmask);
+
+  // Initialize the USART as SPI master
+  void begin();
+
+  // If the bus is used from within an interrupt, this function registers
+  // that interrupt, so beginTransaction() can prevent conflicts. It works
+  // like SPI.usingInterrupt().
+  void usingInterrupt(uint8_t interruptNumber);
+  // And this does the opposite.
+  void notUsingInterrupt(uint8_t interruptNumber);
+
+  // Before using transfer() or asserting chip select pins, this function
+  // is used to gain exclusive access to the bus and configure the correct
+  // settings.
+  inline void beginTransaction(USARTSPISettings settings) {
+    if (interruptMode > 0) {
+      uint8_t sreg = SREG;
+      noInterrupts();
+
+      #ifdef SPI_AVR_EIMSK
+      if (interruptMode == 1) {
+        interruptSave = SPI_AVR_EIMSK;
+        SPI_AVR_EIMSK &= ~interruptMask;
+        SREG = sreg;
+      } else
+      #endif
+      {
+        interruptSave = sreg;
+      }
+    }
+
+    *_ucsrc = settings.ucsrc;
+    setUBRR(settings.ubrr);
+  }
+
+  // Write to the bus (TXD pin) and also receive (RXD pin)
+  inline uint8_t transfer(uint8_t data) {
+    *_udr = data;
+    while (!(*_ucsra & _BV(RXC0))) ;
+    return *_udr;
+  }
+  inline uint16_t transfer16(uint16_t data) {
+    union { uint16_t val; struct { uint8_t lsb; uint8_t msb; }; } in, out;
+    in.val = data;
+    // Both bytes go into the transmit buffer before the first one is read
+    // back, so there is no gap between them
+    if (!(*_ucsrc & USARTSPI_UDORD)) {
+      *_udr = in.msb;
+      while (!(*_ucsra & _BV(UDRE0))) ;
+      *_udr = in.lsb;
+      while (!(*_ucsra & _BV(RXC0))) ;
+      out.msb = *_udr;
+      while (!(*_ucsra & _BV(RXC0))) ;
+      out.lsb = *_udr;
+    } else {
+      *_udr = in.lsb;
+      while (!(*_ucsra & _BV(UDRE0))) ;
+      *_udr = in.msb;
+      while (!(*_ucsra & _BV(RXC0))) ;
+      out.lsb = *_udr;
+      while (!(*_ucsra & _BV(RXC0))) ;
+      out.msb = *_udr;
+    }
+    return out.val;
+  }
+  inline void transfer(void *buf, size_t count) {
+    transfer(buf, buf, count);
+  }
+  // Sends count bytes from txbuf and stores what comes back in rxbuf,
+  // which may be the same buffer. Without txbuf, 0xFF is sent. Without
+  // rxbuf, the received bytes are thrown away and the transmit buffer is
+  // kept full all the time, which is the fastest way to feed a display.
+  void transfer(const void *txbuf, void *rxbuf, size_t count);
+
+  // After performing a group of transfers and releasing the chip select
+  // signal, this function allows others to access the bus
+  inline void endTransaction(void) {
+    if (interruptMode > 0) {
+      #ifdef SPI_AVR_EIMSK
+      uint8_t sreg = SREG;
+      #endif
+      noInterrupts();
+      #ifdef SPI_AVR_EIMSK
+      if (interruptMode == 1) {
+        SPI_AVR_EIMSK = interruptSave;
+        SREG = sreg;
+      } else
+      #endif
+      {
+        SREG = interruptSave;
+      }
+    }
+  }
+
+  // Disable the USART
+  void end();
+
+  // These functions are deprecated, like their SPI counterparts. New
+  // applications should use beginTransaction() to configure the settings.
+  inline void setBitOrder(uint8_t bitOrder) {
+    if (bitOrder == LSBFIRST) *_ucsrc |= USARTSPI_UDORD;
+    else *_ucsrc &= ~USARTSPI_UDORD;
+  }
+  inline void setDataMode(uint8_t dataMode) {
+    *_ucsrc = (*_ucsrc & ~(USARTSPI_UCPHA | USARTSPI_UCPOL)) |
+      ((dataMode >> 1) & USARTSPI_UCPHA) | ((dataMode >> 3) & USARTSPI_UCPOL);
+  }
+  void setClockDivider(uint8_t clockDiv);
+
+private:
+  inline void setUBRR(uint16_t ubrr) {
+    // Writing UBRRnL updates the baud rate, so it goes last
+    *_ubrrh = ubrr >> 8;
+    *_ubrrl = ubrr;
+  }
+
+  volatile uint8_t * const _ubrrh;
+  volatile uint8_t * const _ubrrl;
+  volatile uint8_t * const _ucsra;
+  volatile uint8_t * const _ucsrb;
+  volatile uint8_t * const _ucsrc;
+  volatile uint8_t * const _udr;
+  volatile uint8_t * const _xckddr;
+  const uint8_t _xckmask;
+
+  uint8_t initialized;
+  uint8_t interruptMode; // 0=none, 1=mask, 2=global
+  uint8_t interruptMask; // which interrupts to mask
+  uint8_t interruptSave; // temp storage, to restore state
+};
+
+#if defined(HAVE_USARTSPI0)
+  extern USARTSPIClass USARTSPI;
+#endif
+#if defined(HAVE_USARTSPI1)
+  extern USARTSPIClass USARTSPI1;
+#endif
+
+#endif
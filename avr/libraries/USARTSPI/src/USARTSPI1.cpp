@@ -0,0 +1,19 @@
+/*
+ * USARTSPI1.cpp - USARTSPI instance on USART1
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either the GNU General Public License version 2
+ * or the GNU Lesser General Public License version 2.1, both as
+ * published by the Free Software Foundation.
+ */
+
+#include "USARTSPI.h"
+
+// Each instance is defined in its own file, like the HardwareSerial
+// instances, so only the ones that are used end up in the sketch
+
+#if defined(HAVE_USARTSPI1)
+
+USARTSPIClass USARTSPI1(&UBRR1H, &UBRR1L, &UCSR1A, &UCSR1B, &UCSR1C, &UDR1, USARTSPI1_XCK_PIN);
+
+#endif // HAVE_USARTSPI1
@@ -123,6 +123,12 @@ static const uint8_t SCL = PIN_WIRE_SCL;
 #define digitalPinToPCMSKbit(p)  (((p) <= 7) ? (p) : (((p) <= 13) ? ((p) - 8) : ((p) <= 21) ? ((p) - 14) : ((p) == 22) ? ((p) - 16) : ((p) - 23)))
 #endif
 
+// Compile time versions of the port and bit mask tables, for constant pins
+#define digitalPinToPortReg(p)   (((p) <= 7) ? (&PORTD) : (((p) <= 13 || (p) == 20 || (p) == 21) ? (&PORTB) : (((p) <= 22) ? (&PORTC) : (&PORTE))))
+#define digitalPinToDDRReg(p)    (((p) <= 7) ? (&DDRD) : (((p) <= 13 || (p) == 20 || (p) == 21) ? (&DDRB) : (((p) <= 22) ? (&DDRC) : (&DDRE))))
+#define digitalPinToPINReg(p)    (((p) <= 7) ? (&PIND) : (((p) <= 13 || (p) == 20 || (p) == 21) ? (&PINB) : (((p) <= 22) ? (&PINC) : (&PINE))))
+#define digitalPinToBit(p)       (((p) <= 7) ? (p) : (((p) <= 13) ? ((p) - 8) : (((p) <= 21) ? ((p) - 14) : (((p) == 22) ? 6 : ((p) - 23)))))
+
 #define PIN_PD0 0
 #define PIN_PD1 1
 #define PIN_PD2 2
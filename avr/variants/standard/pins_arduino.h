@@ -149,6 +149,12 @@ static const uint8_t SCL = PIN_WIRE_SCL;
 #define digitalPinToPCMSKbit(p) (((p) <= 7) ? (p) : (((p) <= 13) ? ((p) - 8) : (((p) <= 21) ? ((p) - 14) : (((p) <= 22) ? ((p) - 16) : -1))))
 #endif
 
+// Compile time versions of the port and bit mask tables, for constant pins
+#define digitalPinToPortReg(p)  (((p) <= 7) ? (&PORTD) : (((p) <= 13 || (p) == 20 || (p) == 21) ? (&PORTB) : (&PORTC)))
+#define digitalPinToDDRReg(p)   (((p) <= 7) ? (&DDRD) : (((p) <= 13 || (p) == 20 || (p) == 21) ? (&DDRB) : (&DDRC)))
+#define digitalPinToPINReg(p)   (((p) <= 7) ? (&PIND) : (((p) <= 13 || (p) == 20 || (p) == 21) ? (&PINB) : (&PINC)))
+#define digitalPinToBit(p)      (((p) <= 7) ? (p) : (((p) <= 13) ? ((p) - 8) : (((p) <= 21) ? ((p) - 14) : 6)))
+
 #define PIN_PD0 0
 #define PIN_PD1 1
 #define PIN_PD2 2